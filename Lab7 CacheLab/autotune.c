@@ -0,0 +1,492 @@
+/*
+ * autotune.c - Searches a space of blocked transpose strategies for one
+ *     matrix shape and cache geometry, scores every candidate on the
+ *     simulator from csim.c, and writes the best one as C code that
+ *     registers itself with registerTransFunction.
+ *
+ * Each candidate is replayed here access by access, in the order the
+ * generated code performs them when compiled at -O0 as tracegen is, so
+ * its score is what tracegen-instr reports for the generated kernel,
+ * apart from the few marker and call accesses around it.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include "cachelab.h"
+
+/* Embedded simulator from csim.c (compiled with -DCSIM_LIBRARY) */
+extern void csimInit(int s, int E, int b);
+extern void csimAccess(unsigned long long address, int store);
+extern void csimResults(long *hits, long *misses, long *evictions);
+
+/* Maximum array dimension, as in tracegen.c and test-trans.c */
+#define MAXN 256
+
+/* Tile bodies */
+#define BODY_PLAIN 0  /* B[c][r] = A[r][c] one element at a time */
+#define BODY_DIAG 1   /* plain, but the diagonal element is stored after its row */
+#define BODY_BUFFER 2 /* rows of A go through val1..val8 before B is written */
+#define BODY_STAGED 3 /* 8x8 tiles use the 4x8 staging from the 64x64 kernel */
+
+static const char *body_names[] = {"plain", "diagonal-deferred",
+                                   "register-buffered", "4x8-staged"};
+
+typedef struct strategy
+{
+    int th;       /* tile height (rows of A) */
+    int tw;       /* tile width (columns of A) */
+    int colmajor; /* walk the tiles down the columns of A */
+    int body;
+    long hits, misses, evictions;
+} strategy_t;
+
+#define MAX_CANDIDATES 256
+
+static strategy_t cand[MAX_CANDIDATES];
+static int ncand = 0;
+
+/* Shape and layout of the simulated matrices */
+static int M = 0, N = 0;
+static unsigned long long a_base = 0;
+static unsigned long long b_base = MAXN * MAXN * sizeof(int); /* B follows A in tracegen */
+
+static void loadA(int r, int c)
+{
+    csimAccess(a_base + ((unsigned long long)r * M + c) * sizeof(int), 0);
+}
+
+static void loadB(int r, int c)
+{
+    csimAccess(b_base + ((unsigned long long)r * N + c) * sizeof(int), 0);
+}
+
+static void storeB(int r, int c)
+{
+    csimAccess(b_base + ((unsigned long long)r * N + c) * sizeof(int), 1);
+}
+
+/*
+ * simStaged - Accesses of the 8x8 staged tile at A[i][j] (see
+ *     transTileStaged in trans.c)
+ */
+static void simStaged(int i, int j)
+{
+    int k, x;
+
+    for (k = 0; k < 4; k++)
+    {
+        for (x = 0; x < 8; x++)
+            loadA(i + k, j + x);
+        for (x = 0; x < 4; x++)
+            storeB(j + x, i + k);
+        for (x = 0; x < 4; x++)
+            storeB(j + x, i + k + 4);
+    }
+    for (k = 4; k < 8; k++)
+    {
+        for (x = 0; x < 4; x++)
+            loadB(j + k - 4, i + 4 + x);
+        for (x = 0; x < 4; x++)
+        {
+            loadA(i + 4 + x, j + k - 4);
+            storeB(j + k - 4, i + 4 + x);
+        }
+        for (x = 0; x < 4; x++)
+            storeB(j + k, i + x);
+    }
+    for (k = 0; k < 4; k++)
+    {
+        for (x = 0; x < 4; x++)
+        {
+            loadA(i + 4 + x, j + 4 + k);
+            storeB(j + 4 + k, i + 4 + x);
+        }
+    }
+}
+
+/*
+ * simTile - Accesses of the tile whose top-left element is A[i][j]
+ */
+static void simTile(const strategy_t *st, int i, int j)
+{
+    int ie = i + st->th < N ? i + st->th : N;
+    int je = j + st->tw < M ? j + st->tw : M;
+    int r, c, x;
+
+    if (st->body == BODY_STAGED && ie - i == 8 && je - j == 8)
+    {
+        simStaged(i, j);
+        return;
+    }
+    for (r = i; r < ie; r++)
+    {
+        if (st->body == BODY_BUFFER || st->body == BODY_STAGED)
+        {
+            for (c = j; c + 8 <= je; c += 8)
+            {
+                for (x = 0; x < 8; x++)
+                    loadA(r, c + x);
+                for (x = 0; x < 8; x++)
+                    storeB(c + x, r);
+            }
+            for (; c < je; c++)
+            {
+                loadA(r, c);
+                storeB(c, r);
+            }
+        }
+        else
+        {
+            for (c = j; c < je; c++)
+            {
+                loadA(r, c);
+                if (st->body != BODY_DIAG || r != c)
+                    storeB(c, r);
+            }
+            if (st->body == BODY_DIAG && r >= j && r < je)
+                storeB(r, r);
+        }
+    }
+}
+
+/*
+ * simulate - Score one candidate on a cold cache
+ */
+static void simulate(strategy_t *st, int s, int E, int b)
+{
+    int i, j;
+
+    csimInit(s, E, b);
+    if (st->colmajor)
+    {
+        for (j = 0; j < M; j += st->tw)
+            for (i = 0; i < N; i += st->th)
+                simTile(st, i, j);
+    }
+    else
+    {
+        for (i = 0; i < N; i += st->th)
+            for (j = 0; j < M; j += st->tw)
+                simTile(st, i, j);
+    }
+    csimResults(&st->hits, &st->misses, &st->evictions);
+}
+
+/*
+ * addCandidates - Fill cand[] with the search space
+ */
+static void addCandidates(void)
+{
+    static const int sizes[] = {1, 2, 4, 8, 16, 32};
+    int h, w, order, body;
+
+    for (body = BODY_PLAIN; body <= BODY_STAGED; body++)
+        for (h = 0; h < 6; h++)
+            for (w = 0; w < 6; w++)
+                for (order = 0; order < 2; order++)
+                {
+                    if (body == BODY_BUFFER && sizes[w] % 8 != 0)
+                        continue;
+                    if (body == BODY_STAGED && (sizes[h] != 8 || sizes[w] != 8))
+                        continue;
+                    cand[ncand].th = sizes[h];
+                    cand[ncand].tw = sizes[w];
+                    cand[ncand].colmajor = order;
+                    cand[ncand].body = body;
+                    ncand++;
+                }
+}
+
+/*
+ * describe - One-line description of a candidate
+ */
+static void describe(char *buf, const strategy_t *st)
+{
+    sprintf(buf, "%dx%d %s tiles, %s order", st->th, st->tw,
+            body_names[st->body], st->colmajor ? "column" : "row");
+}
+
+/*
+ * emitTile - Write the tile function of the chosen strategy
+ */
+static void emitTile(FILE *fp, const char *name, const strategy_t *st)
+{
+    if (st->body == BODY_STAGED)
+    {
+        fprintf(fp,
+                "static void %s_staged(int M, int N, int A[N][M], int B[M][N], int i, int j)\n"
+                "{\n"
+                "    int val1, val2, val3, val4, val5, val6, val7, val8;\n"
+                "    int k;\n"
+                "\n"
+                "    for (k = 0; k < 4; k++)\n"
+                "    {\n"
+                "        val1 = A[i + k][j];\n"
+                "        val2 = A[i + k][j + 1];\n"
+                "        val3 = A[i + k][j + 2];\n"
+                "        val4 = A[i + k][j + 3];\n"
+                "        val5 = A[i + k][j + 4];\n"
+                "        val6 = A[i + k][j + 5];\n"
+                "        val7 = A[i + k][j + 6];\n"
+                "        val8 = A[i + k][j + 7];\n"
+                "        B[j][i + k] = val1;\n"
+                "        B[j + 1][i + k] = val2;\n"
+                "        B[j + 2][i + k] = val3;\n"
+                "        B[j + 3][i + k] = val4;\n"
+                "        B[j][i + k + 4] = val5;\n"
+                "        B[j + 1][i + k + 4] = val6;\n"
+                "        B[j + 2][i + k + 4] = val7;\n"
+                "        B[j + 3][i + k + 4] = val8;\n"
+                "    }\n"
+                "    for (k = 4; k < 8; k++)\n"
+                "    {\n"
+                "        val1 = B[j + k - 4][i + 4];\n"
+                "        val2 = B[j + k - 4][i + 5];\n"
+                "        val3 = B[j + k - 4][i + 6];\n"
+                "        val4 = B[j + k - 4][i + 7];\n"
+                "        B[j + k - 4][i + 4] = A[i + 4][j + k - 4];\n"
+                "        B[j + k - 4][i + 5] = A[i + 5][j + k - 4];\n"
+                "        B[j + k - 4][i + 6] = A[i + 6][j + k - 4];\n"
+                "        B[j + k - 4][i + 7] = A[i + 7][j + k - 4];\n"
+                "        B[j + k][i] = val1;\n"
+                "        B[j + k][i + 1] = val2;\n"
+                "        B[j + k][i + 2] = val3;\n"
+                "        B[j + k][i + 3] = val4;\n"
+                "    }\n"
+                "    for (k = 0; k < 4; k++)\n"
+                "    {\n"
+                "        B[j + 4 + k][i + 4] = A[i + 4][j + 4 + k];\n"
+                "        B[j + 4 + k][i + 5] = A[i + 5][j + 4 + k];\n"
+                "        B[j + 4 + k][i + 6] = A[i + 6][j + 4 + k];\n"
+                "        B[j + 4 + k][i + 7] = A[i + 7][j + 4 + k];\n"
+                "    }\n"
+                "}\n\n",
+                name);
+    }
+
+    fprintf(fp,
+            "static void %s_tile(int M, int N, int A[N][M], int B[M][N], int i, int j)\n"
+            "{\n",
+            name);
+    if (st->body == BODY_BUFFER || st->body == BODY_STAGED)
+        fprintf(fp, "    int val1, val2, val3, val4, val5, val6, val7, val8;\n");
+    else if (st->body == BODY_DIAG)
+        fprintf(fp, "    int tmp = 0;\n");
+    fprintf(fp,
+            "    int r, c;\n"
+            "    int ie = i + %d < N ? i + %d : N;\n"
+            "    int je = j + %d < M ? j + %d : M;\n"
+            "\n",
+            st->th, st->th, st->tw, st->tw);
+    if (st->body == BODY_STAGED)
+        fprintf(fp,
+                "    if (ie - i == 8 && je - j == 8)\n"
+                "    {\n"
+                "        %s_staged(M, N, A, B, i, j);\n"
+                "        return;\n"
+                "    }\n",
+                name);
+    fprintf(fp,
+            "    for (r = i; r < ie; r++)\n"
+            "    {\n");
+    if (st->body == BODY_BUFFER || st->body == BODY_STAGED)
+        fprintf(fp,
+                "        for (c = j; c + 8 <= je; c += 8)\n"
+                "        {\n"
+                "            val1 = A[r][c];\n"
+                "            val2 = A[r][c + 1];\n"
+                "            val3 = A[r][c + 2];\n"
+                "            val4 = A[r][c + 3];\n"
+                "            val5 = A[r][c + 4];\n"
+                "            val6 = A[r][c + 5];\n"
+                "            val7 = A[r][c + 6];\n"
+                "            val8 = A[r][c + 7];\n"
+                "            B[c][r] = val1;\n"
+                "            B[c + 1][r] = val2;\n"
+                "            B[c + 2][r] = val3;\n"
+                "            B[c + 3][r] = val4;\n"
+                "            B[c + 4][r] = val5;\n"
+                "            B[c + 5][r] = val6;\n"
+                "            B[c + 6][r] = val7;\n"
+                "            B[c + 7][r] = val8;\n"
+                "        }\n"
+                "        for (; c < je; c++)\n"
+                "            B[c][r] = A[r][c];\n");
+    else if (st->body == BODY_DIAG)
+        fprintf(fp,
+                "        for (c = j; c < je; c++)\n"
+                "        {\n"
+                "            if (r == c)\n"
+                "                tmp = A[r][c];\n"
+                "            else\n"
+                "                B[c][r] = A[r][c];\n"
+                "        }\n"
+                "        if (r >= j && r < je)\n"
+                "            B[r][r] = tmp;\n");
+    else
+        fprintf(fp,
+                "        for (c = j; c < je; c++)\n"
+                "            B[c][r] = A[r][c];\n");
+    fprintf(fp,
+            "    }\n"
+            "}\n\n");
+}
+
+/*
+ * emit - Write the chosen strategy as a registered transpose function
+ */
+static void emit(const char *filename, const char *name, const strategy_t *st,
+                 int s, int E, int b)
+{
+    char desc[128];
+    FILE *fp = fopen(filename, "w");
+
+    if (fp == NULL)
+    {
+        printf("Could not open %s\n", filename);
+        exit(1);
+    }
+    describe(desc, st);
+    fprintf(fp,
+            "/*\n"
+            " * %s - Generated by ./autotune -M %d -N %d -s %d -E %d -b %d\n"
+            " *     Best of %d candidates: %s,\n"
+            " *     %ld simulated misses. Correct for any M and N.\n"
+            " */\n"
+            "#include \"cachelab.h\"\n"
+            "\n",
+            filename, M, N, s, E, b, ncand, desc, st->misses);
+    emitTile(fp, name, st);
+    fprintf(fp,
+            "char %s_desc[] = \"Autotuned for %dx%d (s=%d, E=%d, b=%d): %s\";\n"
+            "void %s(int M, int N, int A[N][M], int B[M][N])\n"
+            "{\n"
+            "    int i, j;\n"
+            "\n",
+            name, M, N, s, E, b, desc, name);
+    if (st->colmajor)
+        fprintf(fp,
+                "    for (j = 0; j < M; j += %d)\n"
+                "        for (i = 0; i < N; i += %d)\n",
+                st->tw, st->th);
+    else
+        fprintf(fp,
+                "    for (i = 0; i < N; i += %d)\n"
+                "        for (j = 0; j < M; j += %d)\n",
+                st->th, st->tw);
+    fprintf(fp,
+            "            %s_tile(M, N, A, B, i, j);\n"
+            "}\n"
+            "\n"
+            "/*\n"
+            " * registerTunedFunctions - Called from registerFunctions in trans.c\n"
+            " *     when built with \"make TUNED=1\"\n"
+            " */\n"
+            "void registerTunedFunctions()\n"
+            "{\n"
+            "    registerTransFunction(%s, %s_desc);\n"
+            "}\n",
+            name, name, name);
+    fclose(fp);
+}
+
+/*
+ * usage - Print usage info
+ */
+static void usage(char *argv[])
+{
+    printf("Usage: %s [-h] -M <rows> -N <cols> [-s <s> -E <E> -b <b>] [-o <file>] [-n <name>] [-k <num>]\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h          Print this help message.\n");
+    printf("  -M <rows>   Number of matrix rows (max %d)\n", MAXN);
+    printf("  -N <cols>   Number of matrix columns (max %d)\n", MAXN);
+    printf("  -s, -E, -b  Cache geometry (default 5, 1, 5)\n");
+    printf("  -o <file>   Generated C file (default trans-tuned.c)\n");
+    printf("  -n <name>   Name of the generated function (default trans_tuned)\n");
+    printf("  -k <num>    Number of ranked candidates to print (default 10)\n");
+    printf("Example: %s -M 61 -N 67 && make clean && make TUNED=1\n", argv[0]);
+}
+
+/*
+ * main - Main routine
+ */
+int main(int argc, char *argv[])
+{
+    char c;
+    char desc[128];
+    const char *outfile = "trans-tuned.c";
+    const char *name = "trans_tuned";
+    int s = 5, E = 1, b = 5, top = 10;
+    int i, j, best;
+    strategy_t tmp;
+
+    while ((c = getopt(argc, argv, "hM:N:s:E:b:o:n:k:")) != -1)
+    {
+        switch (c)
+        {
+        case 'M':
+            M = atoi(optarg);
+            break;
+        case 'N':
+            N = atoi(optarg);
+            break;
+        case 's':
+            s = atoi(optarg);
+            break;
+        case 'E':
+            E = atoi(optarg);
+            break;
+        case 'b':
+            b = atoi(optarg);
+            break;
+        case 'o':
+            outfile = optarg;
+            break;
+        case 'n':
+            name = optarg;
+            break;
+        case 'k':
+            top = atoi(optarg);
+            break;
+        case 'h':
+            usage(argv);
+            exit(0);
+        default:
+            usage(argv);
+            exit(1);
+        }
+    }
+    if (M <= 0 || N <= 0 || M > MAXN || N > MAXN)
+    {
+        printf("Error: M and N must be between 1 and %d\n", MAXN);
+        usage(argv);
+        exit(1);
+    }
+
+    addCandidates();
+    for (i = 0; i < ncand; i++)
+        simulate(&cand[i], s, E, b);
+
+    /* Rank by misses; the sort is stable, so ties keep the simpler candidate */
+    for (i = 1; i < ncand; i++)
+    {
+        tmp = cand[i];
+        for (j = i; j > 0 && cand[j - 1].misses > tmp.misses; j--)
+            cand[j] = cand[j - 1];
+        cand[j] = tmp;
+    }
+    best = 0;
+
+    printf("%d candidates for %dx%d on s=%d E=%d b=%d\n", ncand, M, N, s, E, b);
+    for (i = 0; i < ncand && i < top; i++)
+    {
+        describe(desc, &cand[i]);
+        printf("%3d. misses:%-7ld hits:%-7ld %s\n", i + 1, cand[i].misses,
+               cand[i].hits, desc);
+    }
+    emit(outfile, name, &cand[best], s, E, b);
+    printf("Wrote %s (%s)\n", outfile, name);
+    return 0;
+}
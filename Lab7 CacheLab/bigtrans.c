@@ -0,0 +1,526 @@
+/*
+ * bigtrans.c - Transposes matrices far larger than the MAXN x MAXN lab
+ *     matrices, B = A^T with A stored as N rows of M ints.
+ *
+ * The matrix is cut into square tiles, and every tile is copied in 8x8
+ * blocks through eight registers, the same blocking transpose_submit
+ * uses. The tiles are split across a pool of threads by bands of B
+ * rows. Each thread first-touches its own band of B and its share of
+ * A, so on a NUMA machine each thread writes to pages on its own node.
+ * The run is repeated for 1, 2, 4, ... threads, and the scaling
+ * efficiency is reported.
+ *
+ * With -i/-o it instead transposes a matrix file that may be larger
+ * than memory. Both files are mapped, and the same tiles are walked
+ * band by band of B rows, with a memory budget bounding the band.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define MAX_THREADS 256
+
+/* Arguments and results of one worker thread */
+typedef struct worker
+{
+    pthread_t tid;
+    int id;
+    size_t c0, c1;       /* band of A columns = B rows written */
+    size_t r0, r1;       /* band of A rows first-touched */
+    pthread_barrier_t *ready;
+} worker_t;
+
+/* Matrix shared by all workers */
+static int *A, *B;
+static size_t M, N;      /* A is N x M, B is M x N */
+static size_t tile = 64; /* tile edge in elements */
+static int pin = 1;      /* pin worker i to CPU i (mod the CPU count) */
+static int ncpu;
+
+/*
+ * now_ns - Monotonic wall-clock time in nanoseconds
+ */
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/*
+ * transBlock - 8x8 block at A[i][j], one row of A through eight
+ *     registers at a time, as in transpose_submit
+ */
+static void transBlock(const int *A, int *B, size_t M, size_t N, size_t i, size_t j)
+{
+    int val1, val2, val3, val4, val5, val6, val7, val8;
+    const int *a;
+    int *b;
+    size_t k;
+
+    for (k = 0; k < 8; k++)
+    {
+        a = A + (i + k) * M + j;
+        val1 = a[0];
+        val2 = a[1];
+        val3 = a[2];
+        val4 = a[3];
+        val5 = a[4];
+        val6 = a[5];
+        val7 = a[6];
+        val8 = a[7];
+        b = B + j * N + i + k;
+        b[0] = val1;
+        b[N] = val2;
+        b[2 * N] = val3;
+        b[3 * N] = val4;
+        b[4 * N] = val5;
+        b[5 * N] = val6;
+        b[6 * N] = val7;
+        b[7 * N] = val8;
+    }
+}
+
+/*
+ * transTile - A[r0..r1)[c0..c1) into B, 8x8 blocks with scalar edges
+ */
+void transTile(const int *A, int *B, size_t M, size_t N,
+               size_t r0, size_t r1, size_t c0, size_t c1)
+{
+    size_t i, j;
+    size_t r8 = r0 + (r1 - r0) / 8 * 8, c8 = c0 + (c1 - c0) / 8 * 8;
+
+    for (i = r0; i < r8; i += 8)
+        for (j = c0; j < c8; j += 8)
+            transBlock(A, B, M, N, i, j);
+    for (i = r0; i < r1; i++)
+        for (j = (i < r8 ? c8 : c0); j < c1; j++)
+            B[j * N + i] = A[i * M + j];
+}
+
+/*
+ * worker - First-touch this thread's band, then transpose its tiles.
+ *     The barrier separates the two phases so that the timed part
+ *     only measures the transpose.
+ */
+static void *worker(void *arg)
+{
+    worker_t *w = (worker_t *)arg;
+    size_t i, j, r, c;
+    cpu_set_t set;
+
+    if (pin)
+    {
+        CPU_ZERO(&set);
+        CPU_SET(w->id % ncpu, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+
+    /* First touch: A[i][j] = i*M + j, B zeroed */
+    for (i = w->r0; i < w->r1; i++)
+        for (j = 0; j < M; j++)
+            A[i * M + j] = (int)(i * M + j);
+    memset(B + w->c0 * N, 0, (w->c1 - w->c0) * N * sizeof(int));
+    pthread_barrier_wait(w->ready);
+
+    /* Wait for the main thread to start the clock */
+    pthread_barrier_wait(w->ready);
+    for (c = w->c0; c < w->c1; c += tile)
+        for (r = 0; r < N; r += tile)
+            transTile(A, B, M, N, r, r + tile < N ? r + tile : N,
+                      c, c + tile < w->c1 ? c + tile : w->c1);
+    pthread_barrier_wait(w->ready);
+    return NULL;
+}
+
+/*
+ * run - Transpose once with the given number of threads on freshly
+ *     mapped matrices, and return the wall-clock time in ns
+ */
+static double run(int threads, int *correct)
+{
+    worker_t w[MAX_THREADS];
+    pthread_barrier_t ready;
+    size_t bytes = M * N * sizeof(int), band;
+    size_t i, j;
+    double t0, t;
+    int k;
+
+    /* Fresh pages so that the first touch below decides their node */
+    A = (int *)mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    B = (int *)mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (A == MAP_FAILED || B == MAP_FAILED)
+    {
+        printf("Could not map two %zu byte matrices\n", bytes);
+        exit(1);
+    }
+
+    pthread_barrier_init(&ready, NULL, threads + 1);
+    band = (M / threads + tile - 1) / tile * tile; /* B rows per thread, whole tiles */
+    for (k = 0; k < threads; k++)
+    {
+        w[k].id = k;
+        w[k].c0 = k * band < M ? k * band : M;
+        w[k].c1 = (k + 1) * band < M && k + 1 < threads ? (k + 1) * band : M;
+        w[k].r0 = N * k / threads;
+        w[k].r1 = N * (k + 1) / threads;
+        w[k].ready = &ready;
+        pthread_create(&w[k].tid, NULL, worker, &w[k]);
+    }
+    pthread_barrier_wait(&ready); /* first touch done */
+    t0 = now_ns();
+    pthread_barrier_wait(&ready); /* go */
+    pthread_barrier_wait(&ready); /* all tiles done */
+    t = now_ns() - t0;
+    for (k = 0; k < threads; k++)
+        pthread_join(w[k].tid, NULL);
+    pthread_barrier_destroy(&ready);
+
+    /* B[j][i] must be the value first-touched into A[i][j] */
+    *correct = 1;
+    for (j = 0; j < M && *correct; j++)
+        for (i = 0; i < N; i++)
+            if (B[j * N + i] != (int)(i * M + j))
+            {
+                *correct = 0;
+                break;
+            }
+
+    munmap(A, bytes);
+    munmap(B, bytes);
+    return t;
+}
+
+/*
+ * advise - madvise the pages covering [p, p + len)
+ */
+static void advise(const void *p, size_t len, int advice)
+{
+    static size_t page = 0;
+    size_t start, end;
+
+    if (page == 0)
+        page = (size_t)sysconf(_SC_PAGESIZE);
+    start = (size_t)p / page * page;
+    end = ((size_t)p + len + page - 1) / page * page;
+    madvise((void *)start, end - start, advice);
+}
+
+/*
+ * adviseStrip - madvise the pages under columns [c0, c1) of A rows
+ *     [r0, r1), one call per run of contiguous pages instead of one per
+ *     row (a single call when the strip is whole rows)
+ */
+static void adviseStrip(size_t r0, size_t r1, size_t c0, size_t c1, int advice)
+{
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t start, end, lo = 0, hi = 0, i;
+
+    for (i = r0; i < r1; i++)
+    {
+        start = (size_t)(A + i * M + c0) / page * page;
+        end = ((size_t)(A + i * M + c1) + page - 1) / page * page;
+        if (hi != 0 && start <= hi)
+        {
+            hi = end > hi ? end : hi;
+            continue;
+        }
+        if (hi != 0)
+            madvise((void *)lo, hi - lo, advice);
+        lo = start;
+        hi = end;
+    }
+    if (hi != 0)
+        madvise((void *)lo, hi - lo, advice);
+}
+
+/*
+ * stripBytes - Bytes of A one row pins for a band h columns wide: its
+ *     strip rounded up to whole pages, plus one page when strips can
+ *     straddle a page boundary
+ */
+static size_t stripBytes(size_t h, size_t page)
+{
+    size_t strip = (h * sizeof(int) + page - 1) / page * page;
+
+    if ((M * sizeof(int)) % page != 0 ||
+        ((h * sizeof(int)) % page != 0 && page % (h * sizeof(int)) != 0))
+        strip += page;
+    return strip;
+}
+
+/*
+ * writePattern - Create an input file with A[i][j] = i*M + j
+ */
+static void writePattern(const char *file)
+{
+    FILE *fp = fopen(file, "wb");
+    int *row = (int *)malloc(M * sizeof(int));
+    size_t i, j;
+
+    if (fp == NULL || row == NULL)
+    {
+        printf("Could not create %s\n", file);
+        exit(1);
+    }
+    for (i = 0; i < N; i++)
+    {
+        for (j = 0; j < M; j++)
+            row[j] = (int)(i * M + j);
+        fwrite(row, sizeof(int), M, fp);
+    }
+    free(row);
+    fclose(fp);
+}
+
+/*
+ * outOfCore - Transpose the N x M matrix in file in into file out.
+ *     Output is produced one band of B rows at a time, so dirty pages
+ *     are written back in file order. The band height and the number
+ *     of A rows read per step are sized so that the output band and
+ *     the input strip each take half of the budget. A row's piece of
+ *     the strip is counted as the whole pages it pins, not its bytes,
+ *     and when the budget allows the band is whole pages of A wide, so
+ *     each page of A is read by one band only. A budget too small for
+ *     an 8-column band and a strip of one tile of rows is refused with
+ *     the minimum it needs. The next input strip is prefetched with
+ *     MADV_WILLNEED. Finished strips and bands are dropped with
+ *     MADV_DONTNEED, after writeback of the band has been started.
+ */
+static int outOfCore(const char *in, const char *out, size_t budget, int generate)
+{
+    size_t bytes = M * N * sizeof(int);
+    size_t page = (size_t)sysconf(_SC_PAGESIZE), per_page = page / sizeof(int);
+    size_t h, strip, rows, c0, c1, r0, r1, r, c;
+    size_t hmin = M < 8 ? M : 8, rmin = N < tile ? N : tile, need;
+    struct stat st;
+    int fdi, fdo, correct = 1;
+    double t0, t;
+
+    /* The narrowest band and the shortest strip must each fit in half
+       of the budget; anything less would overrun it */
+    need = hmin * N * sizeof(int) > rmin * stripBytes(hmin, page) ?
+           hmin * N * sizeof(int) : rmin * stripBytes(hmin, page);
+    if (budget < 2 * need)
+    {
+        printf("A %zux%zu out-of-core transpose needs a budget of at least %zu MiB\n",
+               N, M, (2 * need + 1048575) / 1048576);
+        return 0;
+    }
+
+    /* Band of h B rows (h columns of A), narrowed until a strip of
+       tile rows of A fits beside it, then rows of A per step */
+    h = budget / 2 / (N * sizeof(int)) / 8 * 8;
+    h = h < 8 ? 8 : h > M ? M : h;
+    if (h >= per_page && h < M)
+        h = h / per_page * per_page;
+    while (h > hmin && rmin * stripBytes(h, page) > budget / 2)
+        h = h > per_page ? (h - 1) / per_page * per_page : (h - 1) / 8 * 8;
+    strip = stripBytes(h, page);
+    rows = budget / 2 / strip / tile * tile;
+    rows = rows < rmin ? rmin : rows > N ? N : rows;
+
+    if (generate)
+        writePattern(in);
+    if ((fdi = open(in, O_RDONLY)) < 0 || fstat(fdi, &st) < 0 || (size_t)st.st_size != bytes)
+    {
+        printf("%s must hold %zu x %zu ints (%zu bytes)\n", in, N, M, bytes);
+        return 0;
+    }
+    if ((fdo = open(out, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0 || ftruncate(fdo, bytes) < 0)
+    {
+        printf("Could not create %s\n", out);
+        return 0;
+    }
+    A = (int *)mmap(NULL, bytes, PROT_READ, MAP_SHARED, fdi, 0);
+    B = (int *)mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fdo, 0);
+    if (A == MAP_FAILED || B == MAP_FAILED)
+    {
+        printf("Could not map the matrix files\n");
+        return 0;
+    }
+
+    /* Whole rows of A are read in order only when the band is all of A */
+    advise(A, bytes, h == M ? MADV_SEQUENTIAL : MADV_RANDOM);
+    advise(B, bytes, MADV_SEQUENTIAL);
+    printf("Out-of-core transpose of %zux%zu ints (%.1f MiB), budget %.1f MiB: "
+           "bands of %zu rows of B, %zu rows of A per step\n",
+           N, M, bytes / 1048576.0, budget / 1048576.0, h, rows);
+
+    t0 = now_ns();
+    for (c0 = 0; c0 < M; c0 += h)
+    {
+        c1 = c0 + h < M ? c0 + h : M;
+        for (r0 = 0; r0 < N; r0 += rows)
+        {
+            r1 = r0 + rows < N ? r0 + rows : N;
+            /* Ask for the next strip while this one is transposed */
+            adviseStrip(r1, r1 + rows < N ? r1 + rows : N, c0, c1, MADV_WILLNEED);
+            for (r = r0; r < r1; r += tile)
+                for (c = c0; c < c1; c += tile)
+                    transTile(A, B, M, N, r, r + tile < r1 ? r + tile : r1,
+                              c, c + tile < c1 ? c + tile : c1);
+            /* Only this band's pages of these rows are mapped, so the
+               rows can go in one call */
+            advise(A + r0 * M, (r1 - r0) * M * sizeof(int), MADV_DONTNEED);
+        }
+        /* Start writing this band back in order, then let its pages go */
+        sync_file_range(fdo, c0 * N * sizeof(int), (c1 - c0) * N * sizeof(int),
+                        SYNC_FILE_RANGE_WRITE);
+        advise(B + c0 * N, (c1 - c0) * N * sizeof(int), MADV_DONTNEED);
+    }
+    fsync(fdo);
+    t = now_ns() - t0;
+    printf("%.2f s, %.1f MB/s read + written\n", t / 1e9, 2.0 * bytes / t * 1e3);
+
+    /* A generated input has known values, so check the output file */
+    if (generate)
+    {
+        advise(B, bytes, MADV_SEQUENTIAL);
+        for (c = 0; c < M && correct; c++)
+            for (r = 0; r < N; r++)
+                if (B[c * N + r] != (int)(r * M + c))
+                {
+                    printf("Mismatch at B[%zu][%zu]\n", c, r);
+                    correct = 0;
+                    break;
+                }
+        if (correct)
+            printf("Output verified\n");
+    }
+    munmap(A, bytes);
+    munmap(B, bytes);
+    close(fdi);
+    close(fdo);
+    return correct;
+}
+
+/*
+ * usage - Print usage info
+ */
+static void usage(char *argv[])
+{
+    printf("Usage: %s [-h] -M <cols> -N <rows> [-j <threads>] [-t <tile>] [-r <runs>] [-u]\n", argv[0]);
+    printf("       %s [-h] -M <cols> -N <rows> -i <file> -o <file> [-m <MiB>] [-t <tile>] [-g]\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h            Print this help message.\n");
+    printf("  -M <cols>     Columns of A (rows of B)\n");
+    printf("  -N <rows>     Rows of A (columns of B)\n");
+    printf("  -j <threads>  Largest thread count to measure (default: online CPUs)\n");
+    printf("  -t <tile>     Tile edge in elements, a multiple of 8 (default 64)\n");
+    printf("  -r <runs>     Runs per thread count, best is reported (default 3)\n");
+    printf("  -u            Do not pin threads to CPUs\n");
+    printf("  -i <file>     Out-of-core mode: raw N x M int matrix to transpose\n");
+    printf("  -o <file>     Out-of-core mode: file to write the M x N result to\n");
+    printf("  -m <MiB>      Out-of-core memory budget (default 256)\n");
+    printf("  -g            Out-of-core: first write a test pattern to -i, check -o\n");
+    printf("Example: %s -M 16384 -N 16384 -j 16\n", argv[0]);
+    printf("         %s -M 65536 -N 65536 -i a.bin -o b.bin -m 1024\n", argv[0]);
+}
+
+/*
+ * main - Main routine
+ */
+int main(int argc, char *argv[])
+{
+    char c;
+    int threads = ncpu = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int runs = 3, n, k, correct, all_correct = 1;
+    double t, best, base = 0;
+    const char *infile = NULL, *outfile = NULL;
+    size_t budget = 256;
+    int generate = 0;
+
+    while ((c = getopt(argc, argv, "hM:N:j:t:r:ui:o:m:g")) != -1)
+    {
+        switch (c)
+        {
+        case 'M':
+            M = strtoull(optarg, NULL, 10);
+            break;
+        case 'N':
+            N = strtoull(optarg, NULL, 10);
+            break;
+        case 'j':
+            threads = atoi(optarg);
+            break;
+        case 't':
+            tile = strtoull(optarg, NULL, 10);
+            break;
+        case 'r':
+            runs = atoi(optarg);
+            break;
+        case 'u':
+            pin = 0;
+            break;
+        case 'i':
+            infile = optarg;
+            break;
+        case 'o':
+            outfile = optarg;
+            break;
+        case 'm':
+            budget = strtoull(optarg, NULL, 10);
+            break;
+        case 'g':
+            generate = 1;
+            break;
+        case 'h':
+            usage(argv);
+            exit(0);
+        default:
+            usage(argv);
+            exit(1);
+        }
+    }
+    if (M == 0 || N == 0 || tile == 0 || tile % 8 != 0 || runs < 1 ||
+        threads < 1 || threads > MAX_THREADS)
+    {
+        printf("Error: bad or missing argument\n");
+        usage(argv);
+        exit(1);
+    }
+
+    if (infile != NULL || outfile != NULL)
+    {
+        if (infile == NULL || outfile == NULL || budget == 0)
+        {
+            printf("Error: out-of-core mode needs -i, -o and a nonzero -m\n");
+            exit(1);
+        }
+        return outOfCore(infile, outfile, budget << 20, generate) ? 0 : 1;
+    }
+
+    printf("Transpose of %zux%zu ints (%.1f MiB per matrix), %zux%zu tiles\n",
+           N, M, M * N * sizeof(int) / 1048576.0, tile, tile);
+    printf("threads   time(ms)      GB/s   speedup  efficiency\n");
+    /* 1, 2, 4, ... and the requested count itself */
+    for (n = 1; n <= threads; n = (n * 2 > threads && n < threads) ? threads : n * 2)
+    {
+        best = 1e30;
+        for (k = 0; k < runs; k++)
+        {
+            t = run(n, &correct);
+            all_correct &= correct;
+            if (t < best)
+                best = t;
+        }
+        if (n == 1)
+            base = best;
+        printf("%7d %10.2f %9.2f %9.2f %10.1f%%%s\n", n, best / 1e6,
+               2.0 * M * N * sizeof(int) / best, base / best,
+               100.0 * base / best / n, correct ? "" : "  (incorrect)");
+        if (n == threads)
+            break;
+    }
+    return all_correct ? 0 : 1;
+}
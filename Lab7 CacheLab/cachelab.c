@@ -4,8 +4,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <stdint.h>
+#include <string.h>
 #include "cachelab.h"
-#include <time.h>
 
 trans_func_t func_list[MAX_TRANS_FUNCS];
 int func_counter = 0; 
@@ -23,31 +24,81 @@ void printSummary(int hits, int misses, int evictions)
     fclose(output_fp);
 }
 
+/*
+ * Seeded input generator: xorshift64* restarted from the seed by every
+ * fill, so a given seed reproduces the same matrices, and therefore the
+ * same traces, on every run and for every function whatever ran before
+ */
+static unsigned long long input_seed = DEFAULT_SEED;
+static unsigned long long rng_state;
+
+void setSeed(unsigned long long seed)
+{
+    input_seed = seed;
+}
+
+unsigned long long getSeed(void)
+{
+    return input_seed;
+}
+
+/*
+ * restartRandom - Start the sequence over from the seed, mixed with
+ *     splitmix64 so that small or similar seeds give unrelated streams
+ *     and the state is never zero
+ */
+static void restartRandom(void)
+{
+    unsigned long long z = input_seed + 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    z ^= z >> 31;
+    rng_state = z ? z : 1;
+}
+
+/*
+ * nextRandom - Next 32 random bits
+ */
+static inline unsigned int nextRandom(void)
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return (unsigned int)((rng_state * 0x2545f4914f6cdd1dULL) >> 32);
+}
+
+/*
+ * fillRandom - Fill n ints with random bits-bit values minus offset.
+ *     The state stays in a local for the whole loop instead of going
+ *     through memory once per element
+ */
+static void fillRandom(int *p, long n, int bits, int offset)
+{
+    unsigned long long x = rng_state;
+    long i;
+    for (i = 0; i < n; i++)
+    {
+        x ^= x >> 12;
+        x ^= x << 25;
+        x ^= x >> 27;
+        p[i] = (int)((x * 0x2545f4914f6cdd1dULL) >> (64 - bits)) - offset;
+    }
+    rng_state = x;
+}
+
 /* 
  * initMatrix - Initialize the given matrix 
  */
 void initMatrix(int M, int N, int A[N][M], int B[M][N])
 {
-    int i, j;
-    srand(time(NULL));
-    for (i = 0; i < N; i++){
-        for (j = 0; j < M; j++){
-            // A[i][j] = i+j;  /* The matrix created this way is symmetric */
-            A[i][j]=rand();
-            B[j][i]=rand();
-        }
-    }
+    restartRandom();
+    fillRandom(&A[0][0], (long)N * M, 31, 0);
+    fillRandom(&B[0][0], (long)M * N, 31, 0);
 }
 
 void randMatrix(int M, int N, int A[N][M]) {
-    int i, j;
-    srand(time(NULL));
-    for (i = 0; i < N; i++){
-        for (j = 0; j < M; j++){
-            // A[i][j] = i+j;  /* The matrix created this way is symmetric */
-            A[i][j]=rand();
-        }
-    }
+    restartRandom();
+    fillRandom(&A[0][0], (long)N * M, 31, 0);
 }
 
 /* 
@@ -79,5 +130,504 @@ void registerTransFunction(void (*trans)(int M, int N, int[N][M], int[M][N]),
     func_list[func_counter].num_hits = 0;
     func_list[func_counter].num_misses = 0;
     func_list[func_counter].num_evictions =0;
+    func_list[func_counter].op = NULL;
+    func_list[func_counter].kernel_ptr = NULL;
     func_counter++;
 }
+
+/* 
+ * registerKernel - Add a kernel for one of the operations below into
+ *     the list of functions to be tested
+ */
+void registerKernel(const kernel_op_t *op, kernel_t kernel, char* desc)
+{
+    registerTransFunction(NULL, desc);
+    func_list[func_counter - 1].op = op;
+    func_list[func_counter - 1].kernel_ptr = kernel;
+}
+
+/*
+ * fillSmall - Fill n ints with values small enough that the sums and
+ *     products below cannot overflow for any M, N <= 256
+ */
+static void fillSmall(int *p, long n)
+{
+    fillRandom(p, n, 11, 1024);
+}
+
+/*
+ * firstMismatch - Index of the first of n ints that differ, or -1
+ */
+static long firstMismatch(const int *y, const int *expect, long n)
+{
+    long i;
+    for (i = 0; i < n; i++)
+        if (y[i] != expect[i])
+            return i;
+    return -1;
+}
+
+/*
+ * intValue - Element k of an int output, for validation messages
+ */
+static double intValue(const void *Y, long k)
+{
+    return ((const int *)Y)[k];
+}
+
+/*
+ * Matrix multiply Y[N][N] = A[N][M] X[M][N]
+ */
+static void matmulInit(int M, int N, void *A, void *X)
+{
+    restartRandom();
+    fillSmall(A, (long)N * M);
+    fillSmall(X, (long)M * N);
+}
+
+static void matmulRef(int M, int N, const void *a, const void *x, void *y)
+{
+    const int *A = a, *X = x;
+    int *Y = y;
+    int i, j, k, sum;
+    for (i = 0; i < N; i++){
+        for (j = 0; j < N; j++){
+            sum = 0;
+            for (k = 0; k < M; k++)
+                sum += A[i * M + k] * X[k * N + j];
+            Y[i * N + j] = sum;
+        }
+    }
+}
+
+static long matmulValidate(int M, int N, const void *Y, const void *expect)
+{
+    return firstMismatch(Y, expect, (long)N * N);
+}
+
+static long matmulBytes(int M, int N)
+{
+    return (2L * M * N + (long)N * N) * sizeof(int);
+}
+
+const kernel_op_t matmulOp = {
+    "matmul", sizeof(int), matmulInit, matmulRef, matmulValidate, intValue, matmulBytes};
+
+/*
+ * 5-point stencil: each interior Y[i][j] is A[i][j] plus its four
+ * neighbours, border elements are copied from A
+ */
+static void stencilInit(int M, int N, void *A, void *X)
+{
+    restartRandom();
+    fillSmall(A, (long)N * M);
+}
+
+static void stencilRef(int M, int N, const void *a, const void *x, void *y)
+{
+    const int *A = a;
+    int *Y = y;
+    int i, j;
+    for (i = 0; i < N; i++){
+        for (j = 0; j < M; j++){
+            if (i == 0 || j == 0 || i == N - 1 || j == M - 1)
+                Y[i * M + j] = A[i * M + j];
+            else
+                Y[i * M + j] = A[i * M + j] + A[(i - 1) * M + j] +
+                    A[(i + 1) * M + j] + A[i * M + j - 1] + A[i * M + j + 1];
+        }
+    }
+}
+
+static long stencilValidate(int M, int N, const void *Y, const void *expect)
+{
+    return firstMismatch(Y, expect, (long)N * M);
+}
+
+static long stencilBytes(int M, int N)
+{
+    return 2L * M * N * sizeof(int);
+}
+
+const kernel_op_t stencilOp = {
+    "stencil", sizeof(int), stencilInit, stencilRef, stencilValidate, intValue, stencilBytes};
+
+/*
+ * Matrix-vector product Y[N] = A[N][M] X[M]
+ */
+static void matvecInit(int M, int N, void *A, void *X)
+{
+    restartRandom();
+    fillSmall(A, (long)N * M);
+    fillSmall(X, M);
+}
+
+static void matvecRef(int M, int N, const void *a, const void *x, void *y)
+{
+    const int *A = a, *X = x;
+    int *Y = y;
+    int i, j, sum;
+    for (i = 0; i < N; i++){
+        sum = 0;
+        for (j = 0; j < M; j++)
+            sum += A[i * M + j] * X[j];
+        Y[i] = sum;
+    }
+}
+
+static long matvecValidate(int M, int N, const void *Y, const void *expect)
+{
+    return firstMismatch(Y, expect, N);
+}
+
+static long matvecBytes(int M, int N)
+{
+    return ((long)M * N + M + N) * sizeof(int);
+}
+
+const kernel_op_t matvecOp = {
+    "matvec", sizeof(int), matvecInit, matvecRef, matvecValidate, intValue, matvecBytes};
+
+/*
+ * TRANSPOSE_OP - Transpose of an M x N matrix of T, generated once per
+ *     element type. Elements are compared bit for bit: a transpose only
+ *     moves them, so even a float must come out unchanged.
+ */
+#define TRANSPOSE_OP(op, T)                                                   \
+static void op##Init(int M, int N, void *A, void *X)                          \
+{                                                                             \
+    T *a = A;                                                                 \
+    long i;                                                                   \
+    restartRandom();                                                          \
+    for (i = 0; i < (long)N * M; i++)                                         \
+        a[i] = (T)((int)(nextRandom() >> 21) - 1024) / (T)8;                  \
+}                                                                             \
+                                                                              \
+static void op##Ref(int M, int N, const void *a, const void *x, void *y)      \
+{                                                                             \
+    const T *A = a;                                                           \
+    T *Y = y;                                                                 \
+    int i, j;                                                                 \
+    for (i = 0; i < N; i++)                                                   \
+        for (j = 0; j < M; j++)                                               \
+            Y[j * N + i] = A[i * M + j];                                      \
+}                                                                             \
+                                                                              \
+static long op##Validate(int M, int N, const void *Y, const void *expect)     \
+{                                                                             \
+    long i;                                                                   \
+    for (i = 0; i < (long)M * N; i++)                                         \
+        if (memcmp((const T *)Y + i, (const T *)expect + i, sizeof(T)) != 0)  \
+            return i;                                                         \
+    return -1;                                                                \
+}                                                                             \
+                                                                              \
+static double op##Value(const void *Y, long k)                                \
+{                                                                             \
+    return ((const T *)Y)[k];                                                 \
+}                                                                             \
+                                                                              \
+static long op##Bytes(int M, int N)                                           \
+{                                                                             \
+    return 2L * M * N * sizeof(T);                                            \
+}                                                                             \
+                                                                              \
+const kernel_op_t op##Op = {                                                  \
+    "transpose " #T, sizeof(T), op##Init, op##Ref, op##Validate, op##Value,   \
+    op##Bytes}
+
+TRANSPOSE_OP(transposeInt8, int8_t);
+TRANSPOSE_OP(transposeInt16, int16_t);
+TRANSPOSE_OP(transposeFloat, float);
+TRANSPOSE_OP(transposeDouble, double);
+
+/*
+ * tiledIndex - Position of A[i][j] in the tiled layout
+ */
+long tiledIndex(int M, int N, int i, int j)
+{
+    long tiles_per_row = (M + LAYOUT_TILE - 1) / LAYOUT_TILE;
+    long tile = (i / LAYOUT_TILE) * tiles_per_row + j / LAYOUT_TILE;
+    return tile * LAYOUT_TILE * LAYOUT_TILE +
+           (i % LAYOUT_TILE) * LAYOUT_TILE + j % LAYOUT_TILE;
+}
+
+/*
+ * spreadBits - Move bit k of the low 16 bits of v to bit 2k
+ */
+static long spreadBits(unsigned int v)
+{
+    v &= 0xffff;
+    v = (v | (v << 8)) & 0x00ff00ff;
+    v = (v | (v << 4)) & 0x0f0f0f0f;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+}
+
+/*
+ * mortonIndex - Position of A[i][j] in Z-order: the bits of i and j
+ *     interleaved, i's in the odd positions
+ */
+long mortonIndex(int i, int j)
+{
+    return spreadBits(i) << 1 | spreadBits(j);
+}
+
+/*
+ * tiledSize - Ints in the tiled layout, edge tiles included
+ */
+static long tiledSize(int M, int N)
+{
+    return (long)((N + LAYOUT_TILE - 1) / LAYOUT_TILE) *
+           ((M + LAYOUT_TILE - 1) / LAYOUT_TILE) * LAYOUT_TILE * LAYOUT_TILE;
+}
+
+static long layoutBytes(int M, int N)
+{
+    return 2L * M * N * sizeof(int);
+}
+
+/*
+ * layoutInit - Fill a row-major (or AoS) M x N input
+ */
+static void layoutInit(int M, int N, void *A, void *X)
+{
+    restartRandom();
+    fillSmall(A, (long)N * M);
+}
+
+/*
+ * Row-major to tiled. Only the M x N real elements are compared; the
+ * padding of the edge tiles is left to the kernel
+ */
+
+static void toTiledRef(int M, int N, const void *a, const void *x, void *y)
+{
+    const int *A = a;
+    int *Y = y;
+    int i, j;
+    for (i = 0; i < N; i++)
+        for (j = 0; j < M; j++)
+            Y[tiledIndex(M, N, i, j)] = A[i * M + j];
+}
+
+static long toTiledValidate(int M, int N, const void *y, const void *e)
+{
+    const int *Y = y, *expect = e;
+    long k;
+    int i, j;
+    for (i = 0; i < N; i++)
+        for (j = 0; j < M; j++)
+        {
+            k = tiledIndex(M, N, i, j);
+            if (Y[k] != expect[k])
+                return k;
+        }
+    return -1;
+}
+
+const kernel_op_t toTiledOp = {
+    "row-major to tiled", sizeof(int), layoutInit, toTiledRef,
+    toTiledValidate, intValue, layoutBytes};
+
+/*
+ * Tiled to row-major, the inverse of the above
+ */
+static void fromTiledInit(int M, int N, void *A, void *X)
+{
+    restartRandom();
+    fillSmall(A, tiledSize(M, N));
+}
+
+static void fromTiledRef(int M, int N, const void *a, const void *x, void *y)
+{
+    const int *A = a;
+    int *Y = y;
+    int i, j;
+    for (i = 0; i < N; i++)
+        for (j = 0; j < M; j++)
+            Y[i * M + j] = A[tiledIndex(M, N, i, j)];
+}
+
+static long fromTiledValidate(int M, int N, const void *Y, const void *expect)
+{
+    return firstMismatch(Y, expect, (long)N * M);
+}
+
+const kernel_op_t fromTiledOp = {
+    "tiled to row-major", sizeof(int), fromTiledInit, fromTiledRef,
+    fromTiledValidate, intValue, layoutBytes};
+
+/*
+ * Row-major to Morton order. Y spans the enclosing power-of-two square;
+ * only the M x N real elements are compared
+ */
+static void toMortonRef(int M, int N, const void *a, const void *x, void *y)
+{
+    const int *A = a;
+    int *Y = y;
+    int i, j;
+    for (i = 0; i < N; i++)
+        for (j = 0; j < M; j++)
+            Y[mortonIndex(i, j)] = A[i * M + j];
+}
+
+static long toMortonValidate(int M, int N, const void *y, const void *e)
+{
+    const int *Y = y, *expect = e;
+    long k;
+    int i, j;
+    for (i = 0; i < N; i++)
+        for (j = 0; j < M; j++)
+        {
+            k = mortonIndex(i, j);
+            if (Y[k] != expect[k])
+                return k;
+        }
+    return -1;
+}
+
+const kernel_op_t toMortonOp = {
+    "row-major to Morton", sizeof(int), layoutInit, toMortonRef,
+    toMortonValidate, intValue, layoutBytes};
+
+/*
+ * Morton order to row-major, the inverse of the above. A spans the
+ * enclosing Z-order square up to its last real element
+ */
+static void fromMortonInit(int M, int N, void *A, void *X)
+{
+    restartRandom();
+    fillSmall(A, mortonIndex(N - 1, M - 1) + 1);
+}
+
+static void fromMortonRef(int M, int N, const void *a, const void *x, void *y)
+{
+    const int *A = a;
+    int *Y = y;
+    int i, j;
+    for (i = 0; i < N; i++)
+        for (j = 0; j < M; j++)
+            Y[i * M + j] = A[mortonIndex(i, j)];
+}
+
+static long fromMortonValidate(int M, int N, const void *Y, const void *expect)
+{
+    return firstMismatch(Y, expect, (long)N * M);
+}
+
+const kernel_op_t fromMortonOp = {
+    "Morton to row-major", sizeof(int), fromMortonInit, fromMortonRef,
+    fromMortonValidate, intValue, layoutBytes};
+
+/*
+ * Array of structures to structure of arrays: A holds M*N/AOS_FIELDS
+ * records of AOS_FIELDS ints, Y gets field f of record r at f*R + r
+ */
+static void aosToSoaRef(int M, int N, const void *a, const void *x, void *y)
+{
+    const int *A = a;
+    int *Y = y;
+    long r, R = (long)M * N / AOS_FIELDS;
+    int f;
+    for (r = 0; r < R; r++)
+        for (f = 0; f < AOS_FIELDS; f++)
+            Y[f * R + r] = A[r * AOS_FIELDS + f];
+}
+
+static long aosToSoaValidate(int M, int N, const void *Y, const void *expect)
+{
+    return firstMismatch(Y, expect, (long)M * N / AOS_FIELDS * AOS_FIELDS);
+}
+
+const kernel_op_t aosToSoaOp = {
+    "AoS to SoA", sizeof(int), layoutInit, aosToSoaRef,
+    aosToSoaValidate, intValue, layoutBytes};
+
+/*
+ * Structure of arrays to array of structures, the inverse of the above:
+ * field f of record r moves from f*R + r to r*AOS_FIELDS + f
+ */
+static void soaToAosRef(int M, int N, const void *a, const void *x, void *y)
+{
+    const int *A = a;
+    int *Y = y;
+    long r, R = (long)M * N / AOS_FIELDS;
+    int f;
+    for (r = 0; r < R; r++)
+        for (f = 0; f < AOS_FIELDS; f++)
+            Y[r * AOS_FIELDS + f] = A[f * R + r];
+}
+
+const kernel_op_t soaToAosOp = {
+    "SoA to AoS", sizeof(int), layoutInit, soaToAosRef,
+    aosToSoaValidate, intValue, layoutBytes};
+
+/*
+ * In-place transpose, checked against the out-of-place reference
+ */
+static void inPlaceRef(int M, int N, const void *a, const void *x, void *y)
+{
+    const int *A = a;
+    int *Y = y;
+    int i, j;
+    for (i = 0; i < N; i++)
+        for (j = 0; j < M; j++)
+            Y[j * N + i] = A[i * M + j];
+}
+
+static long inPlaceValidate(int M, int N, const void *Y, const void *expect)
+{
+    return firstMismatch(Y, expect, (long)M * N);
+}
+
+const kernel_op_t inPlaceTransposeOp = {
+    "in-place transpose", sizeof(int), layoutInit, inPlaceRef,
+    inPlaceValidate, intValue, layoutBytes, 1};
+
+/*
+ * batchCount - Number of N x M matrices in one batch
+ */
+long batchCount(int M, int N)
+{
+    long size = (long)M * N;
+    return size < BATCH_INTS ? BATCH_INTS / size : 1;
+}
+
+static long batchSize(int M, int N)
+{
+    return batchCount(M, N) * M * N;
+}
+
+static void batchInit(int M, int N, void *A, void *X)
+{
+    restartRandom();
+    fillSmall(A, batchSize(M, N));
+}
+
+static void batchRef(int M, int N, const void *a, const void *x, void *y)
+{
+    const int *A = a;
+    int *Y = y;
+    long m, count = batchCount(M, N), size = (long)M * N;
+    int i, j;
+    for (m = 0; m < count; m++, A += size, Y += size)
+        for (i = 0; i < N; i++)
+            for (j = 0; j < M; j++)
+                Y[j * N + i] = A[i * M + j];
+}
+
+static long batchValidate(int M, int N, const void *Y, const void *expect)
+{
+    return firstMismatch(Y, expect, batchSize(M, N));
+}
+
+static long batchBytes(int M, int N)
+{
+    return 2 * batchSize(M, N) * sizeof(int);
+}
+
+const kernel_op_t batchTransposeOp = {
+    "batched transpose", sizeof(int), batchInit, batchRef,
+    batchValidate, intValue, batchBytes};
@@ -7,6 +7,25 @@
 
 #define MAX_TRANS_FUNCS 100
 
+/* A kernel reads the M x N matrix A and the second input X (a matrix,
+   a vector or unused, depending on the operation) and writes Y. The
+   element type is the operation's, int unless it says otherwise */
+typedef void (*kernel_t)(int M, int N, const void *A, const void *X, void *Y);
+
+/* An operation that registered kernels implement, with everything
+   tracegen and test-trans need to drive and check any of them */
+typedef struct kernel_op{
+  char* name;
+  int elem_size;                               /* bytes per element */
+  void (*init)(int M, int N, void *A, void *X); /* generate the inputs */
+  kernel_t reference;                          /* known-correct result */
+  /* index of the first element of Y that differs from the reference, or -1 */
+  long (*validate)(int M, int N, const void *Y, const void *expect);
+  double (*value)(const void *Y, long k);      /* element k, for messages */
+  long (*bytes)(int M, int N);                 /* bytes read and written once */
+  int in_place;  /* the kernel works on Y alone, which starts as a copy of A */
+} kernel_op_t;
+
 typedef struct trans_func{
   void (*func_ptr)(int M,int N,int[N][M],int[M][N]);
   char* description;
@@ -14,8 +33,43 @@ typedef struct trans_func{
   unsigned int num_hits;
   unsigned int num_misses;
   unsigned int num_evictions;
+  const kernel_op_t *op;  /* NULL for a transpose */
+  kernel_t kernel_ptr;    /* called instead of func_ptr when op is set */
 } trans_func_t;
 
+/* Operations defined in cachelab.c */
+extern const kernel_op_t matmulOp;  /* Y[N][N] = A[N][M] X[M][N] */
+extern const kernel_op_t stencilOp; /* Y[N][M] = 5-point sum of A[N][M] */
+extern const kernel_op_t matvecOp;  /* Y[N] = A[N][M] X[M] */
+/* Y[M][N] = A[N][M]^T for 1-, 2-, 4- and 8-byte elements */
+extern const kernel_op_t transposeInt8Op;
+extern const kernel_op_t transposeInt16Op;
+extern const kernel_op_t transposeFloatOp;
+extern const kernel_op_t transposeDoubleOp;
+/* Layout conversions of an M x N int matrix. Column-major is the
+   transpose above; the tiled layout stores LAYOUT_TILE x LAYOUT_TILE
+   tiles one after another in row-major order, each tile row-major,
+   with the edge tiles padded to full size */
+#define LAYOUT_TILE 8
+extern const kernel_op_t toTiledOp;    /* row-major A to tiled Y */
+extern const kernel_op_t fromTiledOp;  /* tiled A to row-major Y */
+extern const kernel_op_t toMortonOp;   /* row-major A to Z-order Y */
+extern const kernel_op_t fromMortonOp; /* Z-order A to row-major Y */
+extern const kernel_op_t aosToSoaOp;   /* records of AOS_FIELDS ints to one array per field */
+extern const kernel_op_t soaToAosOp;   /* one array per field back to records */
+#define AOS_FIELDS 4
+/* In-place transpose: Y holds A[N][M] and must end up as A^T, M x N */
+extern const kernel_op_t inPlaceTransposeOp;
+/* Batched transpose: A holds batchCount(M, N) N x M matrices one after
+   another, Y gets their M x N transposes in the same order */
+#define BATCH_INTS 4096 /* ints per batch; one matrix if it is larger */
+extern const kernel_op_t batchTransposeOp;
+long batchCount(int M, int N);
+
+/* Position of element (i, j) in the tiled and Morton (Z-order) layouts */
+long tiledIndex(int M, int N, int i, int j);
+long mortonIndex(int i, int j);
+
 /* 
  * printSummary - This function provides a standard way for your cache
  * simulator * to display its final hit and miss statistics
@@ -27,6 +81,12 @@ void printSummary(int hits,  /* number of  hits */
 /* Fill the matrix with data */
 void initMatrix(int M, int N, int A[N][M], int B[M][N]);
 
+/* Seed of every input the tools generate (initMatrix and the op init
+   functions); the same seed gives the same inputs and traces */
+#define DEFAULT_SEED 1
+void setSeed(unsigned long long seed);
+unsigned long long getSeed(void);
+
 /* The baseline trans function that produces correct results. */
 void correctTrans(int M, int N, int A[N][M], int B[M][N]);
 
@@ -34,4 +94,10 @@ void correctTrans(int M, int N, int A[N][M], int B[M][N]);
 void registerTransFunction(
     void (*trans)(int M,int N,int[N][M],int[M][N]), char* desc);
 
+/* Add a kernel implementing op to the function list */
+void registerKernel(const kernel_op_t *op, kernel_t kernel, char* desc);
+
+/* Transpose count rows x cols matrices stored back to back (kernels.c) */
+void transposeBatch(int rows, int cols, long count, const int *in, int *out);
+
 #endif /* CACHELAB_TOOLS_H */
@@ -0,0 +1,132 @@
+#!/bin/sh
+#
+# check-csim.sh - Checks that ./csim gives the same results for a text
+#     trace and for the same trace decoded with -d, alone and in co-run
+#     (-C) mode, and that merged runs refuse what they cannot reproduce
+#     and -C rejects way masks with no way below E.
+#     The traces are generated here with runs in one block, M and I
+#     records, so that decoding actually merges records.
+#
+CSIM=./csim
+DIR=`mktemp -d` || exit 1
+trap 'rm -rf "$DIR"' 0
+status=0
+
+# gen <seed> <file> - a lackey-style trace of short runs over a 64KB region
+gen() {
+    awk -v seed=$1 'BEGIN {
+        srand(seed);
+        for (i = 0; i < 20000; i++) {
+            if (rand() < 0.1)
+                printf "I %x,4\n", 4194304 + int(rand() * 4096);
+            base = int(rand() * 65536);
+            n = 1 + int(rand() * 4);
+            for (k = 0; k < n; k++) {
+                r = rand();
+                op = r < 0.5 ? "L" : r < 0.8 ? "S" : "M";
+                printf " %s %x,4\n", op, base + 4 * k;
+            }
+        }
+    }' > $2
+}
+
+# same <name> <args for text> <args for decoded>
+same() {
+    $CSIM $2 | sed 's/\.trace\b/.X/g' > "$DIR/text.out"
+    $CSIM $3 | sed 's/\(\.v\)\?\.bin\b/.X/g' > "$DIR/bin.out"
+    if cmp -s "$DIR/text.out" "$DIR/bin.out"; then
+        echo "ok   $1"
+    else
+        echo "FAIL $1"
+        diff "$DIR/text.out" "$DIR/bin.out"
+        status=1
+    fi
+}
+
+gen 1 "$DIR/a.trace"
+gen 2 "$DIR/b.trace"
+$CSIM -s 4 -E 4 -b 5 -t "$DIR/a.trace" -d "$DIR/a.bin" > /dev/null
+$CSIM -s 4 -E 4 -b 5 -t "$DIR/b.trace" -d "$DIR/b.bin" > /dev/null
+# -v keeps every record, for co-run with write-through
+$CSIM -v -s 4 -E 4 -b 5 -t "$DIR/a.trace" -d "$DIR/a.v.bin" > /dev/null
+$CSIM -v -s 4 -E 4 -b 5 -t "$DIR/b.trace" -d "$DIR/b.v.bin" > /dev/null
+
+A="$DIR/a"
+B="$DIR/b"
+for p in lru fifo random; do
+    for w in wb wt; do
+        G="-s 4 -E 4 -b 5 -p $p -w $w"
+        same "alone $p/$w" "$G -t $A.trace" "$G -t $A.bin"
+        # merged runs lose their load/store order, which wt co-run needs
+        [ $w = wt ] && X=.v.bin || X=.bin
+        same "co-run $p/$w" "$G -C $A.trace:3 -C $B.trace" "$G -C $A$X:3 -C $B$X"
+        same "co-run masked $p/$w" "$G -C $A.trace:3:0x7 -C $B.trace:1:0xe" \
+             "$G -C $A$X:3:0x7 -C $B$X:1:0xe"
+    done
+done
+
+if $CSIM -s 4 -E 4 -b 5 -w wt -C $A.bin -C $B.bin > /dev/null 2>&1; then
+    echo "FAIL merged decoded trace accepted for wt co-run"
+    status=1
+else
+    echo "ok   merged decoded trace rejected for wt co-run"
+fi
+
+# filters can only split records, so merged runs must refuse them.
+# The markers are data addresses taken from the trace itself
+mark() {
+    awk -v n=$1 '$1 != "I" && ++k == n { split($2, a, ","); print a[1]; exit }' $A.trace
+}
+G="-s 4 -E 4 -b 5"
+for f in "-m `mark 1000`,`mark 30000`" "-r 0-8000" "-x 8000-" "-f LS"; do
+    same "filter $f" "$G $f -t $A.trace" "$G $f -t $A.v.bin"
+    if $CSIM $G $f -t $A.bin > /dev/null 2>&1; then
+        echo "FAIL filter $f accepted for merged decoded trace"
+        status=1
+    else
+        echo "ok   filter $f rejected for merged decoded trace"
+    fi
+done
+
+# runs must not change timing: compare the summary against -v, which
+# simulates every record on its own
+for I in "" "-I 4,2,5"; do
+    G="-s 4 -E 2 -b 5 $I -T dhit=4,penalty=100,mshr=8"
+    $CSIM $G -t $A.trace | grep -v '^[ILSM] ' > "$DIR/run.out"
+    $CSIM -v $G -t $A.trace | grep -v '^[ILSM] ' > "$DIR/v.out"
+    if cmp -s "$DIR/run.out" "$DIR/v.out"; then
+        echo "ok   timing${I:+ $I} same as -v"
+    else
+        echo "FAIL timing${I:+ $I} differs from -v"
+        diff "$DIR/run.out" "$DIR/v.out"
+        status=1
+    fi
+done
+if $CSIM -s 4 -E 2 -b 5 -I 4,2,5 -T dhit=4 -t $A.bin > /dev/null 2>&1; then
+    echo "FAIL merged decoded trace accepted for -T with -I"
+    status=1
+else
+    echo "ok   merged decoded trace rejected for -T with -I"
+fi
+
+# co-run has nowhere to apply these, so it must refuse them
+for f in "-v" "-I 4,2,5" "-T dhit=4" "-m 0,1" "-f L" "-O" "-G s=0-2"; do
+    if $CSIM -s 4 -E 4 -b 5 $f -C $A.trace -C $B.trace > /dev/null 2>&1; then
+        echo "FAIL co-run accepted $f"
+        status=1
+    else
+        echo "ok   co-run rejected $f"
+    fi
+done
+
+for p in lru random; do
+    # a crash also exits non-zero, so look for the usage error itself
+    $CSIM -s 4 -E 4 -b 5 -p $p -C $A.trace:1:0x30 -C $B.trace > "$DIR/mask.out" 2>&1
+    if [ $? -eq 1 ] && grep -q "has no way below E" "$DIR/mask.out"; then
+        echo "ok   mask above E rejected ($p)"
+    else
+        echo "FAIL mask above E not rejected ($p)"
+        status=1
+    fi
+done
+exit $status
@@ -1,51 +1,283 @@
 //name: Jang Yujin, loginID: jangyj2020
 
+#define _POSIX_C_SOURCE 200809L
+
 #include "cachelab.h"
 #include <stdio.h>
 #include <unistd.h>
 #include <getopt.h>
 #include <stdlib.h>
-
-void accessCache(int set, unsigned int tag);
+#include <string.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 typedef struct Line
 {
     int val;
-    unsigned int tag;
-    int used;
+    int dirty;                //write-back에서 수정된 line인지 표시
+    int owner;                //line을 채운 trace 번호 (co-run에서 사용)
+    unsigned long long tag;
+    unsigned long used;
 } Line;
 
-Line **cache;          //cache 동적할당할 포인터
-FILE *result;          //cache hit/miss 결과 저장하는 텍스트 파일
-int s, E, b;           // commend line에서 입력받는 값
-int hitcount = 0;      //hit 개수
-int misscount = 0;     //miss 개수
-int evictioncount = 0; //eviction 개수
-int last_use = 0;      //마지막에 사용된 cache 표시하는 변수
+//교체 정책
+#define POLICY_LRU 0
+#define POLICY_FIFO 1
+#define POLICY_RANDOM 2
+#define POLICY_OPT 3 //Belady MIN, 미래를 알아야 하므로 decode된 trace에서만 가능
+//쓰기 정책: write-back + write-allocate, write-through + no-write-allocate
+#define WRITE_BACK 0
+#define WRITE_THROUGH 1
+
+//accessCache 결과
+#define HIT 0
+#define MISS 1
+#define MISS_EVICT 2
+
+/*
+ * 선택 사항인 timing model. core는 한 cycle에 접근 하나를 issue하고,
+ * data miss는 MSHR 하나를 차지한 채 hit + penalty cycle 뒤에 채워진다.
+ * 이미 채워지는 중인 line에 대한 접근은 그 MSHR에 합쳐진다. MSHR이
+ * 모두 차면 하나가 빌 때까지 멈춘다. rob개 전의 load가 끝나지 않았으면
+ * 다음 접근도 멈추므로, rob=1이면 blocking cache와 같다. instruction
+ * fetch miss는 front-end를 그대로 멈추게 한다.
+ */
+typedef struct Timing
+{
+    int dhit, ihit;        //L1D, L1I hit latency
+    int penalty;           //miss penalty (아래 단계 접근 시간)
+    int mshrs;             //동시에 처리할 수 있는 data miss 개수
+    int rob;               //앞서 간 load를 기다리지 않고 issue할 수 있는 접근 수
+    long long now;         //다음 접근을 issue할 cycle
+    long long end;         //지금까지 끝난 접근 중 가장 늦은 cycle
+    unsigned long long *mshr_block; //MSHR이 채우는 block
+    long long *mshr_ready; //MSHR이 비는 cycle
+    long long *done;       //최근 rob개 접근이 끝나는 cycle (ring)
+    int rob_pos;
+    long accesses[2];      //[0] data, [1] instruction 접근 수
+    long long latency[2];  //접근 latency 합
+    long merged;           //MSHR에 합쳐진 접근 수
+    long long mshr_stall;  //MSHR이 모자라 멈춘 cycle
+    long long rob_stall;   //rob 한계로 멈춘 cycle
+} Timing;
+
+//cache 하나의 geometry, line 배열, 통계를 묶은 구조체
+typedef struct Cache
+{
+    const char *name;      //결과 출력에 쓰는 이름 (L1D, L1I)
+    int s, E, b;           //set index bit 수, set당 line 수, block offset bit 수
+    int S;                 //set 개수
+    unsigned int set_mask; //set bit 추출용 mask
+    int policy;            //교체 정책 (POLICY_*)
+    int write;             //쓰기 정책 (WRITE_*)
+    Line **lines;          //cache 동적할당할 포인터
+    long hitcount;         //hit 개수
+    long misscount;        //miss 개수
+    long evictioncount;    //eviction 개수
+    long memwrites;        //아래 단계로 내려보낸 write 개수 (dirty eviction 또는 write-through)
+    unsigned long last_use; //마지막에 사용된 cache 표시하는 변수
+    unsigned int seed;     //random 교체용 xorshift 상태, cache마다 따로 두어 thread에서도 안전
+    FILE *log;             //hit/miss 결과를 남길 파일, NULL이면 기록하지 않음
+    Timing *timing;        //timing model, NULL이면 hit/miss만 셈
+    int inst;              //instruction cache인지 표시 (timing에서 사용)
+    unsigned long long fill_mask; //새 line을 채울 수 있는 way (bit i = way i), 기본은 전부
+    int owner;             //지금 접근하는 trace 번호
+    int victim_owner;      //마지막 eviction에서 쫓겨난 line의 owner
+    unsigned long long victim_addr; //마지막 eviction에서 쫓겨난 block의 시작 address
+
+    //fully associative fast path (s=0, E가 클 때만 사용)
+    int fast;              //fast path 사용 여부
+    int *hash;             //tag -> way hash table (open addressing, 빈 칸은 -1)
+    unsigned int hash_mask; //hash table 크기 - 1
+    int *prev, *next;      //way별 recency list 연결 (head가 MRU, tail이 LRU)
+    int head, tail;        //recency list 양 끝
+    int filled;            //valid line 개수
+} Cache;
+
+//이 값보다 way가 많은 fully associative cache는 hash + recency list로 처리
+#define FAST_WAYS 8
+
+/*
+ * decode된 trace 기록 하나. 바로 뒤따르는 data 접근이 같은 block을
+ * 건드리면 하나의 run으로 합쳐서, 첫 접근(op) 뒤에 붙은 load/store
+ * 개수만 센다. 같은 block이므로 첫 접근 뒤에는 모두 hit이다.
+ */
+typedef struct Ref
+{
+    unsigned long long addr;
+    unsigned short size;
+    unsigned short loads;       //run 뒤쪽에 합쳐진 load 개수
+    unsigned short stores;      //run 뒤쪽에 합쳐진 store 개수
+    unsigned short lead_stores; //그중 첫 load보다 앞선 store 개수
+    char op; //'I', 'L', 'S', 'M'
+} Ref;
+
+//run 하나에 합칠 수 있는 최대 접근 수
+#define MAX_RUN 65535
+
+//미리 decode해 둔 trace 파일: magic, 기록 개수, run block bit 수, Ref 배열 순서로 저장
+#define TRACE_MAGIC "CSIMREF2"
+typedef struct TraceHeader
+{
+    char magic[8];
+    unsigned long long count;
+    long long run_b; //run을 합친 block 크기 (bit), -1이면 합치지 않음
+} TraceHeader;
+
+//address 구간 [lo, hi)
+typedef struct Range
+{
+    unsigned long long lo, hi;
+} Range;
 
+#define MAX_RANGES 16
+
+/*
+ * trace를 읽으면서 바로 적용하는 filter. start marker 접근부터 end marker
+ * 접근까지를 하나의 window로 보고(둘 다 포함), window 안에서 include 구간
+ * 중 하나에 들고 exclude 구간에는 들지 않으며 op가 맞는 기록만 통과시킨다.
+ */
+typedef struct Filter
+{
+    int markers;                  //marker window를 쓰는지
+    unsigned long long start, end; //marker address
+    int inside;                   //지금 window 안인지
+    long window;                  //지금까지 열린 window 수 - 1
+    Range include[MAX_RANGES];    //비어 있으면 전부 포함
+    Range exclude[MAX_RANGES];
+    int ninclude, nexclude;
+    char ops[8];                  //통과시킬 op, 비어 있으면 전부
+} Filter;
+
+//text trace를 한 줄씩 읽거나 decode된 trace를 mmap해서 읽는 reader
+typedef struct Trace
+{
+    FILE *fp;         //text trace
+    const Ref *refs;  //mmap된 기록 (decode된 trace일 때)
+    long count;
+    long pos;
+    void *map;
+    size_t map_len;
+    int run_b;        //이 block 크기 안에서 연속된 data 접근을 run으로 합침, -1이면 합치지 않음
+    Ref pending;      //아직 이어질 수 있는 run
+    int has_pending;
+    Filter *filter;   //NULL이면 모든 기록을 통과
+    long window;      //마지막으로 돌려준 기록의 marker window 번호
+    long pending_window;
+} Trace;
+
+//co-run에서 공유 cache를 같이 쓰는 trace 하나
+typedef struct CoTrace
+{
+    const char *file;
+    int weight;                 //한 round에 내보내는 data 접근 수 (M은 L, S 두 번)
+    unsigned long long mask;    //채울 수 있는 way (CAT 방식 way mask)
+    Ref *refs;
+    long count, pos;
+    long hits, misses, evictions; //공유 cache에서의 결과
+    long evicted;               //다른 trace 때문에 쫓겨난 line 수
+    long alone_misses;          //같은 mask로 혼자 돌렸을 때의 miss
+} CoTrace;
+
+#define MAX_CORUN 16
+
+//sweep에서 시뮬레이션할 조합 하나와 그 결과
+typedef struct Job
+{
+    int s, E, b, policy, write;
+    long hits, misses, evictions, memwrites;
+} Job;
+
+void initCache(Cache *c, const char *name, int s, int E, int b);
+void freeCache(Cache *c);
+void disableFast(Cache *c);
+int accessCache(Cache *c, unsigned long long address, int store);
+int accessFullyAssoc(Cache *c, unsigned long long tag, int store);
+Line *findLine(Cache *c, unsigned long long address);
+void accessRef(Cache *c, const Ref *r);
+void accessRun(Cache *c, const Ref *r);
+void simulateOpt(Job *job, const Ref *refs, long count, int inst);
+void runCorun(CoTrace *ct, int n, int s, int E, int b, int policy, int write);
+void initTiming(Timing *tm, const char *spec);
+void timeAccess(Cache *c, unsigned long long address, int store, int res);
+void printTiming(Timing *tm);
+int openTrace(Trace *t, const char *filename, int run_b);
+int nextRef(Trace *t, Ref *r);
+void closeTrace(Trace *t);
+int parseRange(const char *str, Range *r);
+Ref *loadTrace(Trace *t, long *count);
+void dumpTrace(const char *filename, const Ref *refs, long count, int run_b);
+int parseGrid(const char *grid, int s, int E, int b);
+void runSweep(int threads, const Ref *refs, long count, FILE *out);
+void usage(char *const *argv);
+void printWindow(Cache *c, long window, long *hits, long *misses, long *evictions);
+void csimInit(int s, int E, int b);
+void csimAccess(unsigned long long address, int store);
+int csimAccessVictim(unsigned long long address, int store, unsigned long long *victim);
+void csimResults(long *hits, long *misses, long *evictions);
+
+const char *policy_names[] = {"lru", "fifo", "random", "opt"};
+const char *write_names[] = {"wb", "wt"};
+
+Cache dcache;  //data cache, L/S/M 기록이 사용
+Cache icache;  //instruction cache, -I 옵션이 있을 때만 I 기록이 사용
+int split = 0; //L1I/L1D 분리 모드인지 표시
+FILE *result;  //cache hit/miss 결과 저장하는 텍스트 파일
+Timing timing; //-T 옵션이 있을 때 쓰는 timing model
+
+//이름으로 정책 번호 찾기, 없으면 -1
+int findName(const char *const *names, int n, const char *name)
+{
+    int i;
+    for (i = 0; i < n; i++)
+        if (strcmp(names[i], name) == 0)
+            return i;
+    return -1;
+}
+
+/*
+ * -DCSIM_LIBRARY로 compile하면 main 없이 simulator만 다른 program에
+ * 들어간다 (tracegen-instr가 trans.c의 접근을 바로 넘겨줌).
+ */
+#ifndef CSIM_LIBRARY
 int main(int argc, char *const *argv)
 {
     //commend line에서 입력된 옵션 값 저장하는 변수
     int opt;
     int verbose = 0;
-    FILE *t;
-    //hit/miss 결과 기록하는 txt 파일
-    result = fopen("result.txt", "w");
-
-    char instruction;
-    unsigned int address;
-    int blockbyte;
+    Trace t;
+    Ref r;
+    const char *tracefile = NULL;
+    const char *grid = NULL;     //sweep할 geometry/정책 목록
+    const char *dumpfile = NULL; //decode한 trace를 저장할 파일
+    const char *outfile = NULL;  //sweep 결과 표를 쓸 파일
+    const char *timespec = NULL; //timing model 설정
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int policy = POLICY_LRU, write = WRITE_BACK, show_writes = 0;
+    int run_b, opt_bound = 0;
+    Ref *refs = NULL;
+    long count = 0;
+    Ref *owned = NULL;           //직접 할당한 decode 배열
+    CoTrace corun[MAX_CORUN];    //-C로 받은 공유 cache trace 목록
+    int ncorun = 0, i;
+    Filter filter;               //-m/-r/-x/-f로 받은 trace filter
+    int filtered = 0, per_window = 0;
+    long window = 0, total_hits = 0, total_misses = 0, total_evictions = 0;
 
-    int set_index = 1;
-    int S = 2;
-    int i, j;
+    int s = 0, E = 0, b = 0;    //L1D geometry
+    int is = 0, iE = 0, ib = 0; //L1I geometry
 
-    while ((opt = getopt(argc, argv, "hvs:E:b:t:")) != -1)
+    memset(&filter, 0, sizeof(filter));
+    filter.window = -1;
+    while ((opt = getopt(argc, argv, "hvs:E:b:t:I:p:w:G:j:o:d:T:OC:m:r:x:f:W")) != -1)
     {
         switch (opt)
         {
         case 'h':
-            break;
+            usage(argv);
+            exit(0);
         case 'v':
             verbose = 1;
             break;
@@ -59,139 +291,1879 @@ int main(int argc, char *const *argv)
             b = atoi(optarg);
             break;
         case 't':
-            t = fopen(optarg, "r");
+            tracefile = optarg;
+            break;
+        case 'I':
+            //instruction cache geometry는 "s,E,b" 형식으로 입력받음
+            if (sscanf(optarg, "%d,%d,%d", &is, &iE, &ib) != 3)
+            {
+                printf("-I option needs <s>,<E>,<b>\n");
+                exit(1);
+            }
+            split = 1;
+            break;
+        case 'p':
+            if ((policy = findName(policy_names, 3, optarg)) < 0)
+            {
+                printf("Unknown replacement policy: %s\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'w':
+            if ((write = findName(write_names, 2, optarg)) < 0)
+            {
+                printf("Unknown write policy: %s\n", optarg);
+                exit(1);
+            }
+            show_writes = 1;
+            break;
+        case 'G':
+            grid = optarg;
+            break;
+        case 'j':
+            threads = atoi(optarg);
+            break;
+        case 'o':
+            outfile = optarg;
+            break;
+        case 'd':
+            dumpfile = optarg;
+            break;
+        case 'T':
+            timespec = optarg;
+            break;
+        case 'O':
+            opt_bound = 1;
+            break;
+        case 'C':
+        {
+            //"file[:weight[:mask]]", 예: a.trace:2:0x0f
+            CoTrace *ct = &corun[ncorun];
+            char *colon;
+            if (ncorun == MAX_CORUN)
+            {
+                printf("At most %d co-run traces\n", MAX_CORUN);
+                exit(1);
+            }
+            memset(ct, 0, sizeof(*ct));
+            ct->file = optarg;
+            ct->weight = 1;
+            ct->mask = ~0ULL;
+            if ((colon = strchr(optarg, ':')) != NULL)
+            {
+                *colon++ = '\0';
+                ct->weight = atoi(colon);
+                if ((colon = strchr(colon, ':')) != NULL)
+                    ct->mask = strtoull(colon + 1, NULL, 0);
+            }
+            if (ct->weight < 1 || ct->mask == 0)
+            {
+                printf("Bad co-run trace: %s\n", optarg);
+                exit(1);
+            }
+            ncorun++;
+            break;
+        }
+        case 'm':
+            //.marker 파일과 같은 16진수 "start,end"
+            if (sscanf(optarg, "%llx,%llx", &filter.start, &filter.end) != 2)
+            {
+                printf("-m option needs <start>,<end>\n");
+                exit(1);
+            }
+            filter.markers = 1;
+            filtered = 1;
+            break;
+        case 'r':
+        case 'x':
+        {
+            Range *range = opt == 'r' ? &filter.include[filter.ninclude] : &filter.exclude[filter.nexclude];
+            if ((opt == 'r' ? filter.ninclude : filter.nexclude) == MAX_RANGES)
+            {
+                printf("At most %d ranges per -%c\n", MAX_RANGES, opt);
+                exit(1);
+            }
+            if (!parseRange(optarg, range))
+            {
+                printf("Bad address range: %s\n", optarg);
+                exit(1);
+            }
+            if (opt == 'r')
+                filter.ninclude++;
+            else
+                filter.nexclude++;
+            filtered = 1;
+            break;
+        }
+        case 'f':
+            if (strlen(optarg) >= sizeof(filter.ops) || strspn(optarg, "ILSM") != strlen(optarg))
+            {
+                printf("-f option takes a subset of ILSM\n");
+                exit(1);
+            }
+            strcpy(filter.ops, optarg);
+            filtered = 1;
+            break;
+        case 'W':
+            per_window = 1;
             break;
+        default:
+            usage(argv);
+            exit(1);
         }
     }
 
-    //S(number of set) 구하기
-    for (i = 1; i < s; i++)
+    if (threads < 1)
+        threads = 1;
+    if (per_window && (!filter.markers || grid != NULL || opt_bound || ncorun > 0))
+    {
+        printf("-W needs -m and cannot be combined with -G, -O or -C\n");
+        exit(1);
+    }
+    //co-run은 trace마다 data cache 하나만 돌리므로 이 옵션들을 적용할 곳이 없음
+    if (ncorun > 0 && (verbose || tracefile != NULL || split || grid != NULL ||
+                       outfile != NULL || dumpfile != NULL || timespec != NULL ||
+                       opt_bound || filtered))
     {
-        set_index += S;
-        S *= 2;
+        printf("-C cannot be combined with -v, -t, -I, -G, -o, -d, -T, -O, -m, -r, -x or -f\n");
+        exit(1);
     }
+    //run은 시뮬레이션할 가장 작은 block 안에서만 합칠 수 있음.
+    //verbose는 접근마다 결과를 남겨야 하므로 합치지 않음
+    run_b = verbose ? -1 : b;
+    if (grid != NULL)
+        run_b = parseGrid(grid, s, E, b);
+    //nextRef는 I 기록을 대기 중인 data run 앞으로 보내는데, L1I/L1D가
+    //timing의 시간과 MSHR을 같이 쓰면 그 순서가 cycle 수를 바꿈
+    if (timespec != NULL && split)
+        run_b = -1;
 
-    //E*S개의 line을 가지는 cache 공간 할당
-    cache = (Line **)malloc(S * sizeof(Line *));
-    for (i = 0; i < S; i++)
-        cache[i] = (Line *)malloc(E * sizeof(Line));
+    //co-run 모드: -C trace들을 하나의 공유 data cache에 섞어서 시뮬레이션
+    if (ncorun > 0)
+    {
+        //way mask는 E를 알아야 확인할 수 있음: 실제 way가 하나도 없으면 채울 곳이 없음
+        for (i = 0; i < ncorun; i++)
+            if (E < 64 && (corun[i].mask & ((1ULL << E) - 1)) == 0)
+            {
+                printf("Co-run mask 0x%llx of %s has no way below E=%d\n",
+                       corun[i].mask, corun[i].file, E);
+                usage(argv);
+                exit(1);
+            }
+        runCorun(corun, ncorun, s, E, b, policy, write);
+        return 0;
+    }
 
-    //cache의 valid, tag, used 값 0으로 초기화
-    for (i = 0; i < S; i++)
+    if (tracefile == NULL || !openTrace(&t, tracefile, run_b))
     {
-        for (j = 0; j < E; j++)
+        printf("Could not open trace file\n");
+        usage(argv);
+        exit(1);
+    }
+    if (filtered)
+        t.filter = &filter;
+    //run은 접근마다의 address와 op 순서를 잃어서 -m/-r/-x/-f를 run 안에서
+    //나눠 적용할 수 없음 (marker가 run 중간에 있으면 보이지 않음).
+    //decode하기 전의 text trace에는 그대로 적용됨
+    if (t.refs != NULL && t.run_b >= 0 &&
+        (filter.markers || filter.ninclude > 0 || filter.nexclude > 0 ||
+         filter.ops[0] != '\0'))
+    {
+        printf("Trace was decoded with runs; apply -m/-r/-x/-f to the text trace"
+               " (with -d to save the result) or decode it with -v\n");
+        usage(argv);
+        exit(1);
+    }
+    if (timespec != NULL && split && t.refs != NULL && t.run_b >= 0)
+    {
+        printf("Trace was decoded with runs; -T with -I needs the text trace"
+               " or one decoded with -v\n");
+        exit(1);
+    }
+    //decode된 trace는 저장할 때의 run 크기를 따름
+    if (t.run_b > run_b)
+    {
+        printf("Trace was decoded with runs of 2^%d bytes; block bits must be at least %d\n",
+               t.run_b, t.run_b);
+        exit(1);
+    }
+
+    //sweep 모드와 dump는 trace를 한 번만 decode해서 메모리에 올려 둠
+    if (grid != NULL || dumpfile != NULL)
+    {
+        FILE *out = stdout;
+
+        refs = loadTrace(&t, &count);
+        if (refs != t.refs)
+            owned = refs;
+        if (dumpfile != NULL)
+            dumpTrace(dumpfile, refs, count, t.run_b);
+        if (grid != NULL)
         {
-            cache[i][j].val = 0;
-            cache[i][j].tag = 0;
-            cache[i][j].used = 0;
+            if (outfile != NULL && (out = fopen(outfile, "w")) == NULL)
+            {
+                printf("Could not open %s\n", outfile);
+                exit(1);
+            }
+            runSweep(threads, refs, count, out);
+            if (out != stdout)
+                fclose(out);
         }
+        free(owned);
+        closeTrace(&t);
+        return 0;
     }
 
-    //trace에서 한 줄씩 읽어와서 hit/miss 판단하기
-    while (fscanf(t, " %c %x,%d", &instruction, &address, &blockbyte) != EOF)
+    //OPT는 뒤쪽 접근을 미리 알아야 하므로 trace 전체를 먼저 decode
+    if (opt_bound)
     {
-        int set = (address >> b) & set_index;  //set bit 구하기
-        unsigned int tag = address >> (b + s); //tag 비트 구하기
-
-        switch (instruction)
+        refs = loadTrace(&t, &count);
+        if (refs != t.refs)
         {
-        case 'L':
-            fprintf(result, "%c, %11x,%d ", instruction, address, blockbyte);
-            accessCache(set, tag);
-            fprintf(result, "\n");
-            break;
-        case 'M':
-            fprintf(result, "%c, %11x,%d ", instruction, address, blockbyte);
-            accessCache(set, tag);
-            accessCache(set, tag);
-            fprintf(result, "\n");
-            break;
-        case 'S':
-            fprintf(result, "%c, %11x,%d ", instruction, address, blockbyte);
-            accessCache(set, tag);
-            fprintf(result, "\n");
-            break;
+            owned = refs;
+            t.refs = refs;
+            t.count = count;
         }
+        t.pos = 0;
+        t.filter = NULL; //이미 filter를 거친 기록
     }
 
-    //verbose option이면 result.txt 내용 모두 출력
+    //verbose option이면 hit/miss 결과를 result.txt에 기록
     if (verbose)
+        result = fopen("result.txt", "w");
+
+    initCache(&dcache, "L1D", s, E, b);
+    dcache.policy = policy;
+    dcache.write = write;
+    dcache.log = result;
+    if (split)
+    {
+        initCache(&icache, "L1I", is, iE, ib);
+        icache.policy = policy;
+        icache.log = result;
+        icache.inst = 1;
+    }
+    if (timespec != NULL)
+    {
+        initTiming(&timing, timespec);
+        dcache.timing = &timing;
+        icache.timing = &timing;
+    }
+
+    //trace에서 한 줄(또는 run 하나)씩 읽어와서 hit/miss 판단하기
+    while (nextRef(&t, &r))
     {
+        //분리 모드가 아니면 instruction fetch는 이전처럼 무시
+        if (r.op == 'I' && !split)
+            continue;
+        //-W: window마다 빈 cache에서 따로 시뮬레이션 (test-trans에서 함수마다 하던 것)
+        if (per_window && t.window != window)
+        {
+            if (dcache.hitcount + dcache.misscount > 0)
+                printWindow(&dcache, window, &total_hits, &total_misses, &total_evictions);
+            window = t.window;
+            freeCache(&dcache);
+            initCache(&dcache, "L1D", s, E, b);
+            dcache.policy = policy;
+            dcache.write = write;
+            dcache.log = result;
+            dcache.timing = timespec != NULL ? &timing : NULL;
+        }
+        if (result != NULL)
+            fprintf(result, "%c, %11llx,%u ", r.op, r.addr, r.size);
+        accessRun(r.op == 'I' ? &icache : &dcache, &r);
+        if (result != NULL)
+            fprintf(result, "\n");
     }
-    printSummary(hitcount, misscount, evictioncount);
 
-    fclose(t);
-    fclose(result);
+    //분리 모드에서는 두 cache의 통계를 모두 출력, 채점용 요약은 L1D 기준
+    if (split)
+    {
+        printf("%s hits:%ld misses:%ld evictions:%ld\n",
+               icache.name, icache.hitcount, icache.misscount, icache.evictioncount);
+        printf("%s hits:%ld misses:%ld evictions:%ld\n",
+               dcache.name, dcache.hitcount, dcache.misscount, dcache.evictioncount);
+    }
+    if (show_writes)
+        printf("%s memory writes:%ld (%s)\n", dcache.name, dcache.memwrites,
+               write_names[dcache.write]);
+    if (timespec != NULL)
+        printTiming(&timing);
+    if (opt_bound)
+    {
+        //같은 geometry에서 Belady OPT가 낼 수 있는 최소 miss와 비교
+        Job bound;
+        if (split)
+        {
+            bound.s = is;
+            bound.E = iE;
+            bound.b = ib;
+            bound.write = WRITE_BACK;
+            simulateOpt(&bound, refs, count, 1);
+            printf("%s OPT hits:%ld misses:%ld evictions:%ld (%s misses:%ld)\n",
+                   icache.name, bound.hits, bound.misses, bound.evictions,
+                   policy_names[policy], icache.misscount);
+        }
+        bound.s = s;
+        bound.E = E;
+        bound.b = b;
+        bound.write = write;
+        simulateOpt(&bound, refs, count, 0);
+        printf("%s OPT hits:%ld misses:%ld evictions:%ld (%s misses:%ld, %.1f%% above OPT)\n",
+               dcache.name, bound.hits, bound.misses, bound.evictions,
+               policy_names[policy], dcache.misscount,
+               bound.misses ? 100.0 * (dcache.misscount - bound.misses) / bound.misses : 0.0);
+    }
+    if (per_window)
+    {
+        //마지막 window까지 더한 합계를 요약으로 출력
+        printWindow(&dcache, window, &total_hits, &total_misses, &total_evictions);
+        printSummary(total_hits, total_misses, total_evictions);
+    }
+    else
+        printSummary(dcache.hitcount, dcache.misscount, dcache.evictioncount);
 
-    for (i = 0; i < S; i++)
-        free(cache[i]);
-    free(cache);
+    free(owned);
+    closeTrace(&t);
+    if (result != NULL)
+        fclose(result);
+
+    freeCache(&dcache);
+    if (split)
+        freeCache(&icache);
 
     return 0;
 }
+#endif /* CSIM_LIBRARY */
+
+//-W 모드에서 window 하나의 결과를 출력하고 합계에 더함
+void printWindow(Cache *c, long window, long *hits, long *misses, long *evictions)
+{
+    printf("window %ld %s hits:%ld misses:%ld evictions:%ld\n",
+           window, c->name, c->hitcount, c->misscount, c->evictioncount);
+    *hits += c->hitcount;
+    *misses += c->misscount;
+    *evictions += c->evictioncount;
+}
+
+/*
+ * Library interface: trace 파일 없이 접근 하나씩 받아서 dcache에 적용.
+ */
+static int lib_ready = 0;
+
+void csimInit(int s, int E, int b)
+{
+    if (lib_ready)
+        freeCache(&dcache);
+    initCache(&dcache, "L1D", s, E, b);
+    lib_ready = 1;
+}
+
+void csimAccess(unsigned long long address, int store)
+{
+    accessCache(&dcache, address, store);
+}
+
+//csimAccess와 같지만 HIT(0), MISS(1), MISS_EVICT(2)를 돌려주고,
+//eviction이면 쫓겨난 block의 address를 *victim에 넣음
+int csimAccessVictim(unsigned long long address, int store, unsigned long long *victim)
+{
+    int res = accessCache(&dcache, address, store);
+    if (res == MISS_EVICT)
+        *victim = dcache.victim_addr;
+    return res;
+}
+
+void csimResults(long *hits, long *misses, long *evictions)
+{
+    *hits = dcache.hitcount;
+    *misses = dcache.misscount;
+    *evictions = dcache.evictioncount;
+}
+
+/*
+ * accessRef - trace 기록 하나를 cache에 적용. M은 load 후 store
+ */
+void accessRef(Cache *c, const Ref *r)
+{
+    switch (r->op)
+    {
+    case 'I':
+    case 'L':
+        timeAccess(c, r->addr, 0, accessCache(c, r->addr, 0));
+        break;
+    case 'M':
+        timeAccess(c, r->addr, 0, accessCache(c, r->addr, 0));
+        timeAccess(c, r->addr, 1, accessCache(c, r->addr, 1));
+        break;
+    case 'S':
+        timeAccess(c, r->addr, 1, accessCache(c, r->addr, 1));
+        break;
+    }
+}
+
+//run 뒤쪽의 hit들을 timing에 반영 (lead store, load, 나머지 store 순서로 가정)
+static void timeHits(Cache *c, unsigned long long address, int lead, int loads, int stores)
+{
+    int i;
+
+    if (c->timing == NULL)
+        return;
+    for (i = 0; i < lead; i++)
+        timeAccess(c, address, 1, HIT);
+    for (i = 0; i < loads; i++)
+        timeAccess(c, address, 0, HIT);
+    for (i = lead; i < stores; i++)
+        timeAccess(c, address, 1, HIT);
+}
+
+/*
+ * accessRun - run 하나를 적용. 첫 접근만 실제로 찾고, 뒤에 합쳐진 접근은
+ *     block이 cache에 남아 있으면 한꺼번에 hit으로 센다. write-through
+ *     store miss처럼 첫 접근 뒤에도 block이 없을 때만 순서대로 따진다.
+ */
+void accessRun(Cache *c, const Ref *r)
+{
+    Line *line;
+    int i, lead;
+
+    accessRef(c, r);
+    if (r->loads + r->stores == 0)
+        return;
+
+    if ((line = findLine(c, r->addr)) != NULL)
+    {
+        timeHits(c, r->addr, r->lead_stores, r->loads, r->stores);
+        c->hitcount += r->loads + r->stores;
+        if (r->stores > 0)
+        {
+            if (c->write == WRITE_BACK)
+                line->dirty = 1;
+            else
+                c->memwrites += r->stores;
+        }
+        return;
+    }
+
+    //no-write-allocate: 첫 load 전의 store는 모두 할당 없는 miss
+    lead = r->lead_stores;
+    c->misscount += lead;
+    c->memwrites += lead;
+    for (i = 0; i < lead; i++)
+        timeAccess(c, r->addr, 1, MISS);
+    if (r->loads > 0)
+    {
+        //첫 load가 block을 채운 뒤에는 모두 hit
+        timeAccess(c, r->addr, 0, accessCache(c, r->addr, 0));
+        timeHits(c, r->addr, 0, r->loads - 1, r->stores - lead);
+        c->hitcount += r->loads - 1 + r->stores - lead;
+        c->memwrites += r->stores - lead;
+    }
+}
+
+void initCache(Cache *c, const char *name, int s, int E, int b)
+{
+    int i, j;
+
+    c->name = name;
+    c->s = s;
+    c->E = E;
+    c->b = b;
+    //S(number of set) 구하기
+    c->S = 1 << s;
+    c->set_mask = c->S - 1;
+    c->policy = POLICY_LRU;
+    c->write = WRITE_BACK;
+    c->hitcount = 0;
+    c->misscount = 0;
+    c->evictioncount = 0;
+    c->memwrites = 0;
+    c->last_use = 0;
+    c->seed = 2463534242u;
+    c->log = NULL;
+    c->timing = NULL;
+    c->inst = 0;
+    c->fill_mask = ~0ULL;
+    c->owner = 0;
+    c->victim_owner = -1;
+
+    //E*S개의 line을 가지는 cache 공간 할당
+    c->lines = (Line **)malloc(c->S * sizeof(Line *));
+    for (i = 0; i < c->S; i++)
+        c->lines[i] = (Line *)malloc(E * sizeof(Line));
+
+    //cache의 valid, dirty, tag, used 값 0으로 초기화
+    for (i = 0; i < c->S; i++)
+    {
+        for (j = 0; j < E; j++)
+        {
+            c->lines[i][j].val = 0;
+            c->lines[i][j].dirty = 0;
+            c->lines[i][j].owner = 0;
+            c->lines[i][j].tag = 0;
+            c->lines[i][j].used = 0;
+        }
+    }
+
+    //set이 하나뿐이고 way가 많으면 hash table과 recency list 준비
+    c->fast = (c->S == 1 && E > FAST_WAYS);
+    if (c->fast)
+    {
+        unsigned int size = 1;
+        while (size < 2 * (unsigned int)E) //load factor 1/2 이하 유지
+            size <<= 1;
+        c->hash = (int *)malloc(size * sizeof(int));
+        c->hash_mask = size - 1;
+        for (i = 0; i < (int)size; i++)
+            c->hash[i] = -1;
+        c->prev = (int *)malloc(E * sizeof(int));
+        c->next = (int *)malloc(E * sizeof(int));
+        c->head = c->tail = -1;
+        c->filled = 0;
+    }
+}
+
+//fully associative fast path를 끄고 scan으로 처리 (way mask를 쓸 때, 빈 cache에서만)
+void disableFast(Cache *c)
+{
+    if (!c->fast)
+        return;
+    free(c->hash);
+    free(c->prev);
+    free(c->next);
+    c->fast = 0;
+}
+
+void freeCache(Cache *c)
+{
+    int i;
+
+    for (i = 0; i < c->S; i++)
+        free(c->lines[i]);
+    free(c->lines);
+    if (c->fast)
+    {
+        free(c->hash);
+        free(c->prev);
+        free(c->next);
+    }
+}
+
+//hit/miss 결과를 log 파일에 남기기
+static void logResult(Cache *c, const char *msg)
+{
+    if (c->log != NULL)
+        fputs(msg, c->log);
+}
+
+//random 교체에서 쓰는 xorshift 난수
+static unsigned int nextRandom(Cache *c)
+{
+    c->seed ^= c->seed << 13;
+    c->seed ^= c->seed >> 17;
+    c->seed ^= c->seed << 5;
+    return c->seed;
+}
 
-void accessCache(int set, unsigned int tag)
+//tag hash 값 (Knuth multiplicative hashing)
+static unsigned int hashTag(Cache *c, unsigned long long tag)
 {
-    int i, evic = 1;
-    int lru, evicLine;
+    return ((unsigned int)(tag ^ (tag >> 32)) * 2654435761u) & c->hash_mask;
+}
 
-    //hit인지 판단
-    for (i = 0; i < E; i++)
+//hash table에서 tag가 있는 slot 찾기, 없으면 -1
+static int findSlot(Cache *c, unsigned long long tag)
+{
+    unsigned int h = hashTag(c, tag);
+    while (c->hash[h] >= 0)
     {
-        if (cache[set][i].val == 1 && cache[set][i].tag == tag)
+        if (c->lines[0][c->hash[h]].tag == tag)
+            return h;
+        h = (h + 1) & c->hash_mask;
+    }
+    return -1;
+}
+
+/*
+ * findLine - address가 들어 있는 line을 교체 상태를 바꾸지 않고 찾기.
+ *     없으면 NULL
+ */
+Line *findLine(Cache *c, unsigned long long address)
+{
+    int i, h;
+    Line *line = c->lines[(address >> c->b) & c->set_mask];
+    unsigned long long tag = address >> (c->b + c->s);
+
+    if (c->fast)
+        return (h = findSlot(c, tag)) >= 0 ? &line[c->hash[h]] : NULL;
+    for (i = 0; i < c->E; i++)
+        if (line[i].val == 1 && line[i].tag == tag)
+            return &line[i];
+    return NULL;
+}
+
+//way i에 새 line을 채울 수 있는지 (64번째 이후 way는 mask가 전부일 때만)
+static int wayAllowed(Cache *c, int i)
+{
+    return i < 64 ? (int)((c->fill_mask >> i) & 1) : c->fill_mask == ~0ULL;
+}
+
+//mask 안에서 random victim 고르기
+static int randomWay(Cache *c)
+{
+    int i, n = 0, k;
+
+    if (c->fill_mask == ~0ULL)
+        return nextRandom(c) % c->E;
+    for (i = 0; i < c->E; i++)
+        n += wayAllowed(c, i);
+    k = nextRandom(c) % n;
+    for (i = 0; !wayAllowed(c, i) || k-- > 0; i++)
+        ;
+    return i;
+}
+
+/*
+ * accessCache - address 하나를 cache에 적용하고 HIT, MISS, MISS_EVICT 중
+ *     하나를 돌려준다. store이면 write-back에서는 line을 dirty로 표시하고,
+ *     write-through에서는 매번 memory write를 세며 miss여도 할당하지 않는다.
+ */
+int accessCache(Cache *c, unsigned long long address, int store)
+{
+    int i, empty = -1;
+    unsigned long lru;
+    int evicLine;
+    int set = (address >> c->b) & c->set_mask;          //set bit 구하기
+    unsigned long long tag = address >> (c->b + c->s); //tag 비트 구하기
+    Line *line = c->lines[set];
+
+    if (c->fast)
+        return accessFullyAssoc(c, tag, store);
+
+    //hit 판단, 빈 line, 교체할 line을 한 번에 찾기. hit은 모든 way에서,
+    //빈 line과 victim은 fill_mask가 허락한 way에서만 찾음
+    lru = ~0UL;
+    evicLine = -1;
+    for (i = 0; i < c->E; i++)
+    {
+        if (line[i].val == 1)
         {
-            last_use++;
-            cache[set][i].used = last_use;
-            hitcount++;
-            fprintf(result, "hit ");
+            if (line[i].tag == tag)
+            {
+                //FIFO와 random은 hit이 교체 순서에 영향을 주지 않음
+                if (c->policy == POLICY_LRU)
+                    line[i].used = ++c->last_use;
+                if (store)
+                {
+                    if (c->write == WRITE_BACK)
+                        line[i].dirty = 1;
+                    else
+                        c->memwrites++;
+                }
+                c->hitcount++;
+                logResult(c, "hit ");
+                return HIT;
+            }
+            if (line[i].used < lru && wayAllowed(c, i))
+            {
+                lru = line[i].used;
+                evicLine = i;
+            }
+        }
+        else if (empty < 0 && wayAllowed(c, i))
+            empty = i;
+    }
+
+    c->misscount++;
+    //write-through는 store miss에 line을 할당하지 않고 바로 memory에 씀
+    if (store && c->write == WRITE_THROUGH)
+    {
+        c->memwrites++;
+        logResult(c, "miss ");
+        return MISS;
+    }
+
+    c->last_use++;
+    //빈 line이 있으면 eviction 없이 채우기
+    if (empty >= 0)
+    {
+        line[empty].val = 1;
+        line[empty].dirty = store;
+        line[empty].owner = c->owner;
+        line[empty].tag = tag;
+        line[empty].used = c->last_use;
+        logResult(c, "miss ");
+        return MISS;
+    }
+    //evicton할 line = LRU/FIFO는 used가 가장 작은 line, random은 아무 line
+    if (c->policy == POLICY_RANDOM)
+        evicLine = randomWay(c);
+    if (line[evicLine].dirty)
+        c->memwrites++;
+    c->victim_owner = line[evicLine].owner;
+    c->victim_addr = (line[evicLine].tag << (c->b + c->s)) |
+                     ((unsigned long long)set << c->b);
+    line[evicLine].owner = c->owner;
+    line[evicLine].dirty = store;
+    line[evicLine].tag = tag;
+    line[evicLine].used = c->last_use;
+    c->evictioncount++;
+    logResult(c, "miss eviction ");
+    return MISS_EVICT;
+}
+
+//slot을 비우고 뒤에 이어진 항목들을 당겨서 linear probing 연결 유지
+static void removeSlot(Cache *c, unsigned int h)
+{
+    unsigned int j = h, home;
+
+    c->hash[h] = -1;
+    for (;;)
+    {
+        j = (j + 1) & c->hash_mask;
+        if (c->hash[j] < 0)
             return;
+        home = hashTag(c, c->lines[0][c->hash[j]].tag);
+        //home이 (h, j] 구간 밖이면 h 자리로 옮겨도 검색 가능
+        if (((j - home) & c->hash_mask) >= ((j - h) & c->hash_mask))
+        {
+            c->hash[h] = c->hash[j];
+            c->hash[j] = -1;
+            h = j;
         }
     }
+}
+
+static void insertSlot(Cache *c, unsigned long long tag, int way)
+{
+    unsigned int h = hashTag(c, tag);
+    while (c->hash[h] >= 0)
+        h = (h + 1) & c->hash_mask;
+    c->hash[h] = way;
+}
+
+//recency list에서 way 떼어내기
+static void unlinkWay(Cache *c, int way)
+{
+    if (c->prev[way] >= 0)
+        c->next[c->prev[way]] = c->next[way];
+    else
+        c->head = c->next[way];
+    if (c->next[way] >= 0)
+        c->prev[c->next[way]] = c->prev[way];
+    else
+        c->tail = c->prev[way];
+}
+
+//way를 recency list 맨 앞(MRU)에 붙이기
+static void pushFront(Cache *c, int way)
+{
+    c->prev[way] = -1;
+    c->next[way] = c->head;
+    if (c->head >= 0)
+        c->prev[c->head] = way;
+    c->head = way;
+    if (c->tail < 0)
+        c->tail = way;
+}
 
-    //eviction이 발생하는지 확인
-    for (i = 0; i < E; i++)
+/*
+ * accessFullyAssoc - set이 하나인 cache를 E와 무관하게 O(1)로 처리.
+ *     tag로 hash table을 찾아 hit을 판단하고, LRU/FIFO victim은 recency
+ *     list의 tail에서 바로 꺼낸다. 결과는 accessCache의 scan과 같다.
+ */
+int accessFullyAssoc(Cache *c, unsigned long long tag, int store)
+{
+    Line *line = c->lines[0];
+    int h = findSlot(c, tag);
+    int way, res;
+
+    if (h >= 0)
     {
-        if (cache[set][i].val == 0)
+        way = c->hash[h];
+        //FIFO와 random은 hit에서 순서를 바꾸지 않음
+        if (c->policy == POLICY_LRU && c->head != way)
+        {
+            unlinkWay(c, way);
+            pushFront(c, way);
+        }
+        if (store)
         {
-            evic = 0;
+            if (c->write == WRITE_BACK)
+                line[way].dirty = 1;
+            else
+                c->memwrites++;
+        }
+        c->hitcount++;
+        logResult(c, "hit ");
+        return HIT;
+    }
+
+    c->misscount++;
+    if (store && c->write == WRITE_THROUGH)
+    {
+        c->memwrites++;
+        logResult(c, "miss ");
+        return MISS;
+    }
+
+    if (c->filled < c->E)
+    {
+        //아직 빈 line이 남아 있으면 순서대로 채우기
+        way = c->filled++;
+        line[way].val = 1;
+        logResult(c, "miss ");
+        res = MISS;
+    }
+    else
+    {
+        way = c->policy == POLICY_RANDOM ? (int)(nextRandom(c) % c->E) : c->tail;
+        if (line[way].dirty)
+            c->memwrites++;
+        c->victim_owner = line[way].owner;
+        c->victim_addr = line[way].tag << c->b; //set이 하나뿐이라 s = 0
+        removeSlot(c, findSlot(c, line[way].tag));
+        unlinkWay(c, way);
+        c->evictioncount++;
+        logResult(c, "miss eviction ");
+        res = MISS_EVICT;
+    }
+    line[way].tag = tag;
+    line[way].dirty = store;
+    line[way].owner = c->owner;
+    insertSlot(c, tag, way);
+    pushFront(c, way);
+    return res;
+}
+
+/*
+ * Belady OPT: 뒤에서부터 trace를 훑어 각 기록이 건드린 block이 다음에
+ * 쓰이는 위치(next use)를 구하고, set마다 next use가 가장 먼 line을
+ * 꺼내는 max-heap으로 교체한다. line의 key는 그 block의 다음 사용
+ * 위치이므로, 위치 i에서 key가 i인 line이 있으면 hit이다.
+ */
+#define NEVER 0x7fffffffffffffffL
+
+typedef struct OptCache
+{
+    int E;
+    long *key;     //line별 다음 사용 위치 (S*E)
+    int *dirty;    //line별 dirty bit
+    int *heap;     //set별 max-heap, line 번호 저장 (S*E)
+    int *hpos;     //line이 heap의 어디에 있는지
+    int *size;     //set별 valid line 개수
+    int *line_at;  //위치 i에서 쓰일 block이 들어 있는 line, 없으면 -1
+} OptCache;
+
+static void optSwap(OptCache *oc, int base, int a, int b)
+{
+    int t = oc->heap[base + a];
+    oc->heap[base + a] = oc->heap[base + b];
+    oc->heap[base + b] = t;
+    oc->hpos[oc->heap[base + a]] = a;
+    oc->hpos[oc->heap[base + b]] = b;
+}
+
+//heap 안의 k번째 line을 key에 맞는 자리로 옮기기
+static void optFix(OptCache *oc, int set, int k)
+{
+    int base = set * oc->E, n = oc->size[set], c;
+
+    while (k > 0 && oc->key[oc->heap[base + k]] > oc->key[oc->heap[base + (k - 1) / 2]])
+    {
+        optSwap(oc, base, k, (k - 1) / 2);
+        k = (k - 1) / 2;
+    }
+    while ((c = 2 * k + 1) < n)
+    {
+        if (c + 1 < n && oc->key[oc->heap[base + c + 1]] > oc->key[oc->heap[base + c]])
+            c++;
+        if (oc->key[oc->heap[base + c]] <= oc->key[oc->heap[base + k]])
             break;
+        optSwap(oc, base, k, c);
+        k = c;
+    }
+}
+
+//line의 다음 사용 위치를 nu로 바꾸기
+static void optSetKey(OptCache *oc, int set, int ln, long nu)
+{
+    oc->key[ln] = nu;
+    if (nu != NEVER)
+        oc->line_at[nu] = ln;
+    optFix(oc, set, oc->hpos[ln]);
+}
+
+//block을 set에 넣기. 자리가 없으면 다음 사용이 가장 먼 line을 내보냄
+static void optInsert(OptCache *oc, Job *job, int set, long nu, int dirty)
+{
+    int base = set * oc->E, ln;
+
+    if (oc->size[set] < oc->E)
+    {
+        ln = base + oc->size[set];
+        oc->heap[base + oc->size[set]] = ln;
+        oc->hpos[ln] = oc->size[set]++;
+    }
+    else
+    {
+        ln = oc->heap[base];
+        if (oc->key[ln] != NEVER)
+            oc->line_at[oc->key[ln]] = -1;
+        if (oc->dirty[ln])
+            job->memwrites++;
+        job->evictions++;
+    }
+    oc->dirty[ln] = dirty;
+    optSetKey(oc, set, ln, nu);
+}
+
+/*
+ * simulateOpt - job의 geometry와 쓰기 정책으로 Belady OPT를 시뮬레이션.
+ *     inst이면 I 기록만, 아니면 data 기록만 본다. run 처리 방식은
+ *     accessRun과 같다.
+ */
+void simulateOpt(Job *job, const Ref *refs, long count, int inst)
+{
+    OptCache oc;
+    long *next_use = (long *)malloc((count + 1) * sizeof(long));
+    unsigned long long *hkey, block;
+    long *hval, i, nu;
+    unsigned long hsize = 1, h;
+    int S = 1 << job->s, set, ln, acc, st, lead, wt = job->write == WRITE_THROUGH;
+
+    job->hits = job->misses = job->evictions = job->memwrites = 0;
+
+    //뒤에서부터 block -> 가장 가까운 다음 위치 hash로 next use 구하기
+    while (hsize < 2 * (unsigned long)count + 2)
+        hsize <<= 1;
+    hkey = (unsigned long long *)malloc(hsize * sizeof(unsigned long long));
+    hval = (long *)malloc(hsize * sizeof(long));
+    for (h = 0; h < hsize; h++)
+        hval[h] = -1;
+    for (i = count - 1; i >= 0; i--)
+    {
+        if ((refs[i].op == 'I') != inst)
+            continue;
+        block = refs[i].addr >> job->b;
+        h = (block * 0x9e3779b97f4a7c15ULL) >> 20 & (hsize - 1);
+        while (hval[h] >= 0 && hkey[h] != block)
+            h = (h + 1) & (hsize - 1);
+        next_use[i] = hval[h] >= 0 ? hval[h] : NEVER;
+        hkey[h] = block;
+        hval[h] = i;
+    }
+    free(hkey);
+    free(hval);
+
+    oc.E = job->E;
+    oc.key = (long *)malloc(S * job->E * sizeof(long));
+    oc.dirty = (int *)malloc(S * job->E * sizeof(int));
+    oc.heap = (int *)malloc(S * job->E * sizeof(int));
+    oc.hpos = (int *)malloc(S * job->E * sizeof(int));
+    oc.size = (int *)calloc(S, sizeof(int));
+    oc.line_at = (int *)malloc((count + 1) * sizeof(int));
+    for (i = 0; i < count; i++)
+        oc.line_at[i] = -1;
+
+    for (i = 0; i < count; i++)
+    {
+        const Ref *r = &refs[i];
+        if ((r->op == 'I') != inst)
+            continue;
+        set = (r->addr >> job->b) & (S - 1);
+        nu = next_use[i];
+        acc = (r->op == 'M' ? 2 : 1) + r->loads + r->stores;       //전체 접근 수
+        st = (r->op == 'M' || r->op == 'S') + r->stores;          //그중 store 수
+        ln = oc.line_at[i];
+
+        if (ln >= 0)
+        {
+            //block이 남아 있으면 run 전체가 hit
+            job->hits += acc;
+            optSetKey(&oc, set, ln, nu);
+            if (st > 0 && !wt)
+                oc.dirty[ln] = 1;
+        }
+        else if (r->op == 'S' && wt)
+        {
+            //no-write-allocate: 첫 load가 올 때까지는 할당 없는 miss
+            lead = 1 + r->lead_stores;
+            job->misses += lead;
+            if (r->loads > 0)
+            {
+                job->misses++;
+                job->hits += acc - lead - 1;
+                optInsert(&oc, job, set, nu, 0);
+            }
+        }
+        else
+        {
+            job->misses++;
+            job->hits += acc - 1;
+            optInsert(&oc, job, set, nu, st > 0 && !wt);
+        }
+        if (wt)
+            job->memwrites += st;
+    }
+
+    free(next_use);
+    free(oc.key);
+    free(oc.dirty);
+    free(oc.heap);
+    free(oc.hpos);
+    free(oc.size);
+    free(oc.line_at);
+}
+
+/*
+ * expandRuns - co-run용으로 run으로 합쳐진 기록들을 data 접근 하나씩으로
+ *     풀어서 새 배열로 돌려준다. run 안의 순서는 timeHits처럼 첫 접근,
+ *     lead store, load, 나머지 store 순서로 가정한다. run 안의 M은 load와
+ *     store로 나뉘어 있으므로 맨 앞의 M도 L, S로 나눠야 text trace와 같은
+ *     수로 셈. I 기록은 공유 data cache와 상관없고, decode할 때 run 앞으로
+ *     옮겨져 있어서 weight 순서를 바꾸므로 뺀다. count는 풀린 수로 바뀐다.
+ */
+static Ref *expandRuns(const Ref *refs, long *count)
+{
+    long i, n = 0;
+    int k;
+    Ref *out, one;
+
+    for (i = 0; i < *count; i++)
+        if (refs[i].op != 'I')
+            n += 1 + (refs[i].op == 'M') + refs[i].loads + refs[i].stores;
+    out = (Ref *)malloc((n > 0 ? n : 1) * sizeof(Ref));
+    n = 0;
+    for (i = 0; i < *count; i++)
+    {
+        if (refs[i].op == 'I')
+            continue;
+        one = refs[i];
+        one.loads = one.stores = one.lead_stores = 0;
+        if (one.op == 'M')
+        {
+            one.op = 'L';
+            out[n++] = one;
+            one.op = 'S';
         }
+        out[n++] = one;
+        one.op = 'S';
+        for (k = 0; k < refs[i].lead_stores; k++)
+            out[n++] = one;
+        one.op = 'L';
+        for (k = 0; k < refs[i].loads; k++)
+            out[n++] = one;
+        one.op = 'S';
+        for (k = refs[i].lead_stores; k < refs[i].stores; k++)
+            out[n++] = one;
     }
-    //evicton할 line 찾기 = 가장 최근에 쓰이지 않은 line 찾기
-    if (evic)
+    *count = n;
+    return out;
+}
+
+/*
+ * runCorun - 여러 trace를 weight만큼씩 돌아가며 하나의 공유 cache에 넣는다.
+ *     trace마다 hit/miss와, 같은 way mask로 혼자 돌렸을 때보다 늘어난
+ *     miss, 다른 trace에게 빼앗긴 line 수를 출력한다. 서로 다른
+ *     process로 보고, trace 번호를 address 맨 위 bit에 넣어 구분한다.
+ */
+void runCorun(CoTrace *ct, int n, int s, int E, int b, int policy, int write)
+{
+    Cache c;
+    Trace t;
+    Ref r, *refs;
+    int k, w, left, masked = 0;
+    long i, h0, m0, e0;
+
+    for (k = 0; k < n; k++)
     {
-        lru = cache[set][0].used;
-        evicLine = 0;
-        for (i = 1; i < E; i++)
+        //섞어서 돌리므로 run으로 합치지 않음
+        if (!openTrace(&t, ct[k].file, -1))
+        {
+            printf("Could not open trace file %s\n", ct[k].file);
+            exit(1);
+        }
+        //write-through는 store miss에 line을 채우지 않아서, 다른 trace가 run
+        //중간에 line을 빼앗으면 run이 잃어버린 load/store 순서가 결과를 바꿈
+        if (write == WRITE_THROUGH && t.refs != NULL && t.run_b >= 0)
         {
-            if (cache[set][i].used < lru)
+            printf("%s merges runs, so co-run with -w wt needs the text trace"
+                   " or one decoded with -v\n", ct[k].file);
+            exit(1);
+        }
+        refs = loadTrace(&t, &ct[k].count);
+        //decode된 trace의 run은 접근 하나씩으로 풀어야 text trace와 같은
+        //순서로 섞임. address를 바꿔야 하므로 mmap된 기록도 여기서 복사됨
+        ct[k].refs = expandRuns(refs, &ct[k].count);
+        if (refs != t.refs)
+            free(refs);
+        closeTrace(&t);
+        for (i = 0; i < ct[k].count; i++)
+            ct[k].refs[i].addr ^= (unsigned long long)k << 56;
+        if (ct[k].mask != ~0ULL)
+            masked = 1;
+
+        //혼자 돌렸을 때의 miss
+        initCache(&c, "L1D", s, E, b);
+        c.policy = policy;
+        c.write = write;
+        c.fill_mask = ct[k].mask;
+        if (masked)
+            disableFast(&c);
+        for (i = 0; i < ct[k].count; i++)
+            accessRef(&c, &ct[k].refs[i]);
+        ct[k].alone_misses = c.misscount;
+        freeCache(&c);
+    }
+
+    initCache(&c, "L1D", s, E, b);
+    c.policy = policy;
+    c.write = write;
+    if (masked)
+        disableFast(&c);
+    //round마다 trace k에서 접근 weight개씩 꺼내서 적용, 끝난 trace는 건너뜀
+    do
+    {
+        left = 0;
+        for (k = 0; k < n; k++)
+        {
+            c.owner = k;
+            c.fill_mask = ct[k].mask;
+            for (w = 0; w < ct[k].weight && ct[k].pos < ct[k].count; w++)
             {
-                lru = cache[set][i].used;
-                evicLine = i;
+                r = ct[k].refs[ct[k].pos++];
+                h0 = c.hitcount;
+                m0 = c.misscount;
+                e0 = c.evictioncount;
+                c.victim_owner = -1;
+                accessRef(&c, &r);
+                ct[k].hits += c.hitcount - h0;
+                ct[k].misses += c.misscount - m0;
+                ct[k].evictions += c.evictioncount - e0;
+                if (c.victim_owner >= 0 && c.victim_owner != k)
+                    ct[c.victim_owner].evicted++;
             }
+            if (ct[k].pos < ct[k].count)
+                left = 1;
         }
-        cache[set][evicLine].tag = tag;
-        last_use++;
-        cache[set][evicLine].used = last_use;
-        evictioncount++;
-        misscount++;
-        fprintf(result, "miss eviction ");
+    } while (left);
+
+    printf("Co-run of %d traces on s=%d E=%d b=%d (%s/%s)\n",
+           n, s, E, b, policy_names[policy], write_names[write]);
+    for (k = 0; k < n; k++)
+    {
+        printf("trace %d %s (weight %d, mask 0x%llx): hits:%ld misses:%ld evictions:%ld"
+               " alone misses:%ld extra:%ld (%+.1f%%) lines lost to others:%ld\n",
+               k, ct[k].file, ct[k].weight, ct[k].mask, ct[k].hits, ct[k].misses,
+               ct[k].evictions, ct[k].alone_misses, ct[k].misses - ct[k].alone_misses,
+               ct[k].alone_misses ? 100.0 * (ct[k].misses - ct[k].alone_misses) / ct[k].alone_misses : 0.0,
+               ct[k].evicted);
+        free(ct[k].refs);
+    }
+    printSummary(c.hitcount, c.misscount, c.evictioncount);
+    freeCache(&c);
+}
+
+/*
+ * initTiming - "dhit=4,ihit=1,penalty=100,mshr=8,rob=64" 형식의 설정 해석.
+ *     빠진 항목은 기본값을 쓴다.
+ */
+void initTiming(Timing *tm, const char *spec)
+{
+    char key[16];
+    int val, len, i;
+
+    memset(tm, 0, sizeof(*tm));
+    tm->dhit = 1;
+    tm->ihit = -1;
+    tm->penalty = 100;
+    tm->mshrs = 8;
+    tm->rob = 64;
+    while (*spec != '\0')
+    {
+        if (sscanf(spec, "%15[a-z]=%d%n", key, &val, &len) != 2 || val < 0)
+            goto bad;
+        if (strcmp(key, "dhit") == 0 || strcmp(key, "hit") == 0)
+            tm->dhit = val;
+        else if (strcmp(key, "ihit") == 0)
+            tm->ihit = val;
+        else if (strcmp(key, "penalty") == 0)
+            tm->penalty = val;
+        else if (strcmp(key, "mshr") == 0 && val > 0)
+            tm->mshrs = val;
+        else if (strcmp(key, "rob") == 0 && val > 0)
+            tm->rob = val;
+        else
+            goto bad;
+        spec += len;
+        if (*spec == ',')
+            spec++;
+    }
+    if (tm->ihit < 0)
+        tm->ihit = tm->dhit;
+
+    tm->mshr_block = (unsigned long long *)malloc(tm->mshrs * sizeof(unsigned long long));
+    tm->mshr_ready = (long long *)calloc(tm->mshrs, sizeof(long long));
+    tm->done = (long long *)calloc(tm->rob, sizeof(long long));
+    for (i = 0; i < tm->mshrs; i++)
+        tm->mshr_block[i] = ~0ULL;
+    return;
+
+bad:
+    printf("Bad timing spec: %s\n", spec);
+    exit(1);
+}
+
+/*
+ * timeAccess - accessCache 결과(res)를 timing model에 반영. MSHR과 rob
+ *     한계 때문에 멈춘 cycle을 세고, 접근 하나의 latency를 더한다.
+ */
+void timeAccess(Cache *c, unsigned long long address, int store, int res)
+{
+    Timing *tm = c->timing;
+    unsigned long long block = address >> c->b;
+    long long lat, complete;
+    int i, slot = -1, pending = -1;
+
+    if (tm == NULL)
         return;
+
+    //instruction fetch는 끝날 때까지 다음 issue를 막음
+    if (c->inst)
+    {
+        lat = res == HIT ? tm->ihit : tm->ihit + tm->penalty;
+        tm->accesses[1]++;
+        tm->latency[1] += lat;
+        tm->now += lat;
+        if (tm->now > tm->end)
+            tm->end = tm->now;
+        return;
+    }
+
+    //rob개 전의 접근이 아직 안 끝났으면 기다림
+    if (tm->done[tm->rob_pos] > tm->now)
+    {
+        tm->rob_stall += tm->done[tm->rob_pos] - tm->now;
+        tm->now = tm->done[tm->rob_pos];
+    }
+
+    //같은 block을 채우는 중인 MSHR과 빈 MSHR 찾기
+    for (i = 0; i < tm->mshrs; i++)
+    {
+        if (tm->mshr_ready[i] <= tm->now)
+        {
+            if (slot < 0)
+                slot = i;
+        }
+        else if (tm->mshr_block[i] == block)
+            pending = i;
     }
+
+    if (pending >= 0)
+    {
+        //채워지는 중인 line: hit이든 miss든 그 fill을 기다림
+        lat = tm->mshr_ready[pending] - tm->now;
+        if (lat < tm->dhit)
+            lat = tm->dhit;
+        tm->merged++;
+    }
+    else if (res == HIT || (store && c->write == WRITE_THROUGH))
+        lat = tm->dhit; //write-through store miss는 write buffer로 감
     else
     {
-        for (i = 0; i < E; i++)
+        if (slot < 0)
+        {
+            //MSHR이 모두 차 있으면 가장 먼저 끝나는 것을 기다림
+            slot = 0;
+            for (i = 1; i < tm->mshrs; i++)
+                if (tm->mshr_ready[i] < tm->mshr_ready[slot])
+                    slot = i;
+            tm->mshr_stall += tm->mshr_ready[slot] - tm->now;
+            tm->now = tm->mshr_ready[slot];
+        }
+        lat = tm->dhit + tm->penalty;
+        tm->mshr_block[slot] = block;
+        tm->mshr_ready[slot] = tm->now + lat;
+    }
+
+    //store는 store buffer로 들어가므로 뒤따르는 접근을 막지 않음
+    complete = tm->now + (store ? tm->dhit : lat);
+    tm->done[tm->rob_pos] = complete;
+    tm->rob_pos = (tm->rob_pos + 1) % tm->rob;
+    if (tm->now + lat > tm->end)
+        tm->end = tm->now + lat;
+    tm->accesses[0]++;
+    tm->latency[0] += lat;
+    tm->now++;
+}
+
+/*
+ * printTiming - AMAT와 stall cycle 출력. 이상적인 경우는 접근 하나를
+ *     한 cycle에 issue하는 것이고, 그보다 더 걸린 cycle을 stall로 본다.
+ */
+void printTiming(Timing *tm)
+{
+    long total = tm->accesses[0] + tm->accesses[1];
+    long long cycles = tm->end > tm->now ? tm->end : tm->now;
+
+    printf("Timing: cycles:%lld stall cycles:%lld (mshr full:%lld rob full:%lld) merged:%ld\n",
+           cycles, cycles - total, tm->mshr_stall, tm->rob_stall, tm->merged);
+    printf("AMAT: L1D %.2f", tm->accesses[0] ? (double)tm->latency[0] / tm->accesses[0] : 0.0);
+    if (tm->accesses[1])
+        printf(" L1I %.2f", (double)tm->latency[1] / tm->accesses[1]);
+    printf(" overall %.2f cycles\n",
+           total ? (double)(tm->latency[0] + tm->latency[1]) / total : 0.0);
+}
+
+/*
+ * parseRef - lackey 형식 한 줄(" L 04222cac,4", "I  0400d7d4,8")을 해석.
+ *     memory 접근 기록이 아닌 줄(valgrind 메시지 등)이면 0을 돌려준다.
+ */
+static int parseRef(const char *p, Ref *r)
+{
+    unsigned long long addr = 0;
+    unsigned int size = 0;
+    int digits = 0;
+
+    while (*p == ' ')
+        p++;
+    if (*p != 'I' && *p != 'L' && *p != 'S' && *p != 'M')
+        return 0;
+    r->op = *p++;
+    if (*p != ' ')
+        return 0;
+    while (*p == ' ')
+        p++;
+    for (;; p++, digits++)
+    {
+        if (*p >= '0' && *p <= '9')
+            addr = (addr << 4) | (*p - '0');
+        else if (*p >= 'a' && *p <= 'f')
+            addr = (addr << 4) | (*p - 'a' + 10);
+        else if (*p >= 'A' && *p <= 'F')
+            addr = (addr << 4) | (*p - 'A' + 10);
+        else
+            break;
+    }
+    if (digits == 0 || *p++ != ',')
+        return 0;
+    while (*p >= '0' && *p <= '9')
+        size = size * 10 + (*p++ - '0');
+    r->addr = addr;
+    r->size = size;
+    r->loads = r->stores = r->lead_stores = 0;
+    return 1;
+}
+
+/*
+ * openTrace - trace 파일 열기. 앞부분이 TRACE_MAGIC이면 decode된 trace로
+ *     보고 mmap, 아니면 text trace로 한 줄씩 읽으면서 2^run_b byte block
+ *     안에 머무는 연속 data 접근을 run으로 합친다.
+ */
+int openTrace(Trace *t, const char *filename, int run_b)
+{
+    TraceHeader hdr;
+    struct stat st;
+    int fd;
+
+    memset(t, 0, sizeof(*t));
+    t->run_b = run_b;
+    if ((t->fp = fopen(filename, "r")) == NULL)
+        return 0;
+    //pipe(-t /dev/stdin)는 되감을 수 없으므로 header 확인 없이 text trace로 읽음
+    if (fstat(fileno(t->fp), &st) == 0 && !S_ISREG(st.st_mode))
+        return 1;
+    if (fread(&hdr, sizeof(hdr), 1, t->fp) == 1 &&
+        memcmp(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic)) == 0)
+    {
+        fd = fileno(t->fp);
+        if (fstat(fd, &st) < 0 ||
+            (size_t)st.st_size < sizeof(hdr) + hdr.count * sizeof(Ref))
+            return 0;
+        t->map_len = st.st_size;
+        t->map = mmap(NULL, t->map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (t->map == MAP_FAILED)
+            return 0;
+        posix_madvise(t->map, t->map_len, POSIX_MADV_SEQUENTIAL);
+        t->refs = (const Ref *)((char *)t->map + sizeof(hdr));
+        t->count = hdr.count;
+        t->run_b = hdr.run_b;
+        fclose(t->fp);
+        t->fp = NULL;
+        return 1;
+    }
+    rewind(t->fp);
+    return 1;
+}
+
+//text trace에서 다음 memory 접근 기록 한 줄 읽기, 끝이면 0
+static int readLine(Trace *t, Ref *r)
+{
+    char buf[1000];
+    size_t len;
+
+    while (fgets(buf, sizeof(buf), t->fp) != NULL)
+    {
+        //buf보다 긴 줄은 나머지를 버림
+        len = strlen(buf);
+        if (len > 0 && buf[len - 1] != '\n')
+        {
+            int ch;
+            while ((ch = fgetc(t->fp)) != EOF && ch != '\n')
+                ;
+        }
+        if (parseRef(buf, r))
+            return 1;
+    }
+    return 0;
+}
+
+/*
+ * filterRef - 기록 하나가 filter를 통과하면 1. test-trans가 하던 것처럼
+ *     marker 접근은 window 시작/끝을 정하고 그 자신도 window에 포함된다.
+ */
+static int filterRef(Filter *f, const Ref *r)
+{
+    int i, keep;
+
+    if (f->markers && r->addr == f->start && !f->inside)
+    {
+        f->inside = 1;
+        f->window++;
+    }
+    keep = !f->markers || f->inside;
+    if (keep && f->ninclude > 0)
+    {
+        keep = 0;
+        for (i = 0; i < f->ninclude && !keep; i++)
+            keep = r->addr >= f->include[i].lo && r->addr < f->include[i].hi;
+    }
+    for (i = 0; i < f->nexclude && keep; i++)
+        keep = r->addr < f->exclude[i].lo || r->addr >= f->exclude[i].hi;
+    if (keep && f->ops[0] != '\0')
+        keep = strchr(f->ops, r->op) != NULL;
+    if (f->markers && r->addr == f->end && f->inside)
+        f->inside = 0;
+    return keep;
+}
+
+//"lo-hi" 형식(16진수, hi는 포함하지 않음)의 구간 읽기. 비운 쪽은 끝까지
+int parseRange(const char *str, Range *r)
+{
+    char *end;
+
+    r->lo = 0;
+    r->hi = ~0ULL;
+    if (*str != '-')
+    {
+        r->lo = strtoull(str, &end, 16);
+        if (end == str)
+            return 0;
+        str = end;
+    }
+    if (*str++ != '-')
+        return 0;
+    if (*str != '\0')
+    {
+        r->hi = strtoull(str, &end, 16);
+        if (*end != '\0')
+            return 0;
+    }
+    return r->lo < r->hi;
+}
+
+//cur를 run 뒤에 붙일 수 있으면 붙이고 1을 돌려줌
+static int extendRun(Trace *t, Ref *run, const Ref *cur)
+{
+    if ((run->addr >> t->run_b) != (cur->addr >> t->run_b) ||
+        run->loads + run->stores + 2 > MAX_RUN)
+        return 0;
+    switch (cur->op)
+    {
+    case 'L':
+        run->loads++;
+        break;
+    case 'S':
+        if (run->loads == 0)
+            run->lead_stores++;
+        run->stores++;
+        break;
+    case 'M':
+        run->loads++;
+        run->stores++;
+        break;
+    }
+    return 1;
+}
+
+/*
+ * nextRef - 다음 기록(또는 run) 읽기, 끝이면 0. I 기록은 다른 cache로
+ *     가므로 data run을 끊지 않고 먼저 내보낸다.
+ */
+int nextRef(Trace *t, Ref *r)
+{
+    Ref cur;
+    long w;
+
+    if (t->refs != NULL)
+    {
+        //filter는 run을 합치지 않은 (-v로 decode한) trace에만 옴.
+        //run에는 나눠 적용할 수 없어서 main에서 막음
+        while (t->pos < t->count)
+        {
+            *r = t->refs[t->pos++];
+            if (t->filter == NULL || filterRef(t->filter, r))
+            {
+                t->window = t->filter != NULL ? t->filter->window : 0;
+                return 1;
+            }
+        }
+        return 0;
+    }
+    while (readLine(t, &cur))
+    {
+        //filter는 run으로 합치기 전에 기록 하나씩 적용
+        if (t->filter != NULL && !filterRef(t->filter, &cur))
+            continue;
+        w = t->filter != NULL ? t->filter->window : 0;
+        if (t->run_b < 0 || cur.op == 'I')
+        {
+            *r = cur;
+            t->window = w;
+            return 1;
+        }
+        //run은 window 경계를 넘지 않음
+        if (t->has_pending && t->pending_window == w &&
+            extendRun(t, &t->pending, &cur))
+            continue;
+        if (t->has_pending)
+        {
+            *r = t->pending;
+            t->window = t->pending_window;
+            t->pending = cur;
+            t->pending_window = w;
+            return 1;
+        }
+        t->pending = cur;
+        t->pending_window = w;
+        t->has_pending = 1;
+    }
+    if (t->has_pending)
+    {
+        *r = t->pending;
+        t->window = t->pending_window;
+        t->has_pending = 0;
+        return 1;
+    }
+    return 0;
+}
+
+void closeTrace(Trace *t)
+{
+    if (t->map != NULL)
+        munmap(t->map, t->map_len);
+    if (t->fp != NULL)
+        fclose(t->fp);
+}
+
+/*
+ * loadTrace - trace 전체를 Ref 배열로 decode. mmap된 trace면 복사 없이
+ *     그대로 돌려준다.
+ */
+Ref *loadTrace(Trace *t, long *count)
+{
+    long n = 0, cap = 1 << 16;
+    Ref *refs;
+
+    //filter가 없으면 mmap된 기록을 그대로 씀
+    if (t->refs != NULL && t->filter == NULL)
+    {
+        *count = t->count;
+        return (Ref *)t->refs;
+    }
+    refs = (Ref *)malloc(cap * sizeof(Ref));
+    while (nextRef(t, &refs[n]))
+    {
+        if (++n == cap)
         {
-            if (cache[set][i].val == 0)
+            cap *= 2;
+            refs = (Ref *)realloc(refs, cap * sizeof(Ref));
+        }
+    }
+    *count = n;
+    return refs;
+}
+
+//decode된 trace를 다음 실행에서 mmap할 수 있게 저장
+void dumpTrace(const char *filename, const Ref *refs, long count, int run_b)
+{
+    TraceHeader hdr;
+    FILE *fp = fopen(filename, "wb");
+
+    if (fp == NULL)
+    {
+        printf("Could not open %s\n", filename);
+        exit(1);
+    }
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic));
+    hdr.count = count;
+    hdr.run_b = run_b;
+    fwrite(&hdr, sizeof(hdr), 1, fp);
+    fwrite(refs, sizeof(Ref), count, fp);
+    fclose(fp);
+}
+
+/*
+ * Sweep mode: trace를 한 번 decode해 두고 geometry/정책 조합 전체를
+ * thread pool에서 동시에 시뮬레이션한다.
+ */
+static Job *jobs;
+static int job_count;
+static int job_next;
+static pthread_mutex_t job_lock = PTHREAD_MUTEX_INITIALIZER;
+static const Ref *sweep_refs;
+static long sweep_count;
+
+static void *sweepWorker(void *arg)
+{
+    Cache c;
+    Job *job;
+    long i;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&job_lock);
+        job = job_next < job_count ? &jobs[job_next++] : NULL;
+        pthread_mutex_unlock(&job_lock);
+        if (job == NULL)
+            return NULL;
+
+        if (job->policy == POLICY_OPT)
+        {
+            simulateOpt(job, sweep_refs, sweep_count, 0);
+            continue;
+        }
+        initCache(&c, "L1D", job->s, job->E, job->b);
+        c.policy = job->policy;
+        c.write = job->write;
+        for (i = 0; i < sweep_count; i++)
+        {
+            //sweep은 data cache만 다룸
+            if (sweep_refs[i].op != 'I')
+                accessRun(&c, &sweep_refs[i]);
+        }
+        job->hits = c.hitcount;
+        job->misses = c.misscount;
+        job->evictions = c.evictioncount;
+        job->memwrites = c.memwrites;
+        freeCache(&c);
+    }
+}
+
+/*
+ * parseList - "1,2,4" 또는 "0-6" 형식의 숫자 목록 해석. dbl이면
+ *     범위를 두 배씩 늘려 가며 채운다 (E=1-16 -> 1,2,4,8,16).
+ */
+static int parseList(const char *str, int *vals, int max, int dbl)
+{
+    int n = 0, lo, hi, len;
+
+    while (*str != '\0' && n < max)
+    {
+        if (sscanf(str, "%d-%d%n", &lo, &hi, &len) == 2)
+        {
+            for (; lo <= hi && n < max; lo = dbl ? (lo ? lo * 2 : 1) : lo + 1)
+                vals[n++] = lo;
+        }
+        else if (sscanf(str, "%d%n", &lo, &len) == 1)
+            vals[n++] = lo;
+        else
+            return -1;
+        str += len;
+        if (*str == ',')
+            str++;
+    }
+    return n;
+}
+
+//정책 이름 목록 해석
+static int parseNames(const char *str, const char *const *names, int nnames,
+                      int *vals, int max)
+{
+    char buf[64];
+    int n = 0, len;
+
+    while (*str != '\0' && n < max)
+    {
+        len = strcspn(str, ",");
+        if (len >= (int)sizeof(buf))
+            return -1;
+        memcpy(buf, str, len);
+        buf[len] = '\0';
+        if ((vals[n++] = findName(names, nnames, buf)) < 0)
+            return -1;
+        str += len;
+        if (*str == ',')
+            str++;
+    }
+    return n;
+}
+
+#define MAX_GRID 64
+
+/*
+ * parseGrid - grid("s=0-6 E=1-16 b=4,5 p=lru,fifo w=wb,wt")의 모든 조합을
+ *     jobs에 채운다. grid에 없는 항목은 -s/-E/-b 값과 lru, wb를 쓴다.
+ *     run을 합칠 수 있는 가장 작은 block bit 수를 돌려준다.
+ */
+int parseGrid(const char *grid, int s, int E, int b)
+{
+    int sv[MAX_GRID] = {s}, Ev[MAX_GRID] = {E}, bv[MAX_GRID] = {b};
+    int pv[MAX_GRID] = {POLICY_LRU}, wv[MAX_GRID] = {WRITE_BACK};
+    int ns = 1, nE = 1, nb = 1, np = 1, nw = 1;
+    int i, j, k, l, m, n, min_b = 63;
+    char item[256];
+    const char *p = grid;
+    Job *job;
+
+    //공백 또는 ';'로 나뉜 key=value 항목 해석
+    while (*p != '\0')
+    {
+        int len = strcspn(p, " ;");
+        if (len > 0)
+        {
+            if (len >= (int)sizeof(item) || p[1] != '=')
+                goto bad;
+            memcpy(item, p, len);
+            item[len] = '\0';
+            switch (item[0])
             {
-                cache[set][i].val = 1;
-                cache[set][i].tag = tag;
-                last_use++;
-                cache[set][i].used = last_use;
-                misscount++;
-                fprintf(result, "miss ");
-                return;
+            case 's':
+                n = ns = parseList(item + 2, sv, MAX_GRID, 0);
+                break;
+            case 'E':
+                n = nE = parseList(item + 2, Ev, MAX_GRID, 1);
+                break;
+            case 'b':
+                n = nb = parseList(item + 2, bv, MAX_GRID, 0);
+                break;
+            case 'p':
+                n = np = parseNames(item + 2, policy_names, 4, pv, MAX_GRID);
+                break;
+            case 'w':
+                n = nw = parseNames(item + 2, write_names, 2, wv, MAX_GRID);
+                break;
+            default:
+                n = -1;
             }
+            if (n <= 0)
+                goto bad;
         }
+        p += len;
+        if (*p != '\0')
+            p++;
     }
-}
\ No newline at end of file
+
+    job_count = ns * nE * nb * np * nw;
+    jobs = (Job *)calloc(job_count, sizeof(Job));
+    job = jobs;
+    for (i = 0; i < ns; i++)
+        for (j = 0; j < nE; j++)
+            for (k = 0; k < nb; k++)
+                for (l = 0; l < np; l++)
+                    for (m = 0; m < nw; m++, job++)
+                    {
+                        job->s = sv[i];
+                        job->E = Ev[j];
+                        job->b = bv[k];
+                        job->policy = pv[l];
+                        job->write = wv[m];
+                        if (job->E <= 0 || job->s < 0 || job->b < 0 || job->s + job->b > 63)
+                            goto bad;
+                        if (job->b < min_b)
+                            min_b = job->b;
+                    }
+    return min_b;
+
+bad:
+    printf("Bad sweep grid: %s\n", grid);
+    exit(1);
+}
+
+/*
+ * runSweep - parseGrid가 만든 조합을 threads개의 thread로 시뮬레이션하고
+ *     결과 표를 out에 쓴다.
+ */
+void runSweep(int threads, const Ref *refs, long count, FILE *out)
+{
+    int i;
+    pthread_t *tids;
+    Job *job;
+    char pw[16]; //"policy/write", 표의 한 칸으로 정렬
+
+    sweep_refs = refs;
+    sweep_count = count;
+    job_next = 0;
+    if (threads > job_count)
+        threads = job_count;
+    tids = (pthread_t *)malloc(threads * sizeof(pthread_t));
+    for (i = 0; i < threads; i++)
+        pthread_create(&tids[i], NULL, sweepWorker, NULL);
+    for (i = 0; i < threads; i++)
+        pthread_join(tids[i], NULL);
+    free(tids);
+
+    fprintf(out, "%3s %6s %3s %10s %9s %12s %12s %12s %12s %8s\n", "s", "E", "b",
+            "bytes", "policy", "hits", "misses", "evictions", "memwrites", "missrate");
+    for (i = 0; i < job_count; i++)
+    {
+        job = &jobs[i];
+        snprintf(pw, sizeof(pw), "%s/%s", policy_names[job->policy], write_names[job->write]);
+        fprintf(out, "%3d %6d %3d %10ld %9s %12ld %12ld %12ld %12ld %8.4f\n",
+                job->s, job->E, job->b, (long)job->E << (job->s + job->b), pw,
+                job->hits, job->misses, job->evictions, job->memwrites,
+                job->hits + job->misses ? (double)job->misses / (job->hits + job->misses) : 0.0);
+    }
+    free(jobs);
+}
+
+/*
+ * usage - Print usage info
+ */
+void usage(char *const *argv)
+{
+    printf("Usage: %s [-hv] -s <num> -E <num> -b <num> -t <file> [-I <s>,<E>,<b>]\n", argv[0]);
+    printf("       %s -G <grid> [-j <threads>] [-o <file>] -t <file>\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h              Print this help message.\n");
+    printf("  -v              Optional verbose flag (log every access to result.txt).\n");
+    printf("  -s <num>        Number of set index bits.\n");
+    printf("  -E <num>        Number of lines per set.\n");
+    printf("  -b <num>        Number of block offset bits.\n");
+    printf("  -t <file>       Trace file (text, or decoded with -d).\n");
+    printf("  -I <s>,<E>,<b>  Simulate I records in a separate L1I cache.\n");
+    printf("  -p <policy>     Replacement policy: lru (default), fifo, random.\n");
+    printf("  -w <policy>     Write policy: wb (write-back, default), wt (write-through).\n");
+    printf("  -G <grid>       Sweep the data cache, e.g. \"s=0-6 E=1-16 b=5 p=lru,fifo w=wb,wt\".\n");
+    printf("                  E ranges double (1-16 is 1,2,4,8,16).\n");
+    printf("  -j <threads>    Number of sweep threads (default: online CPUs).\n");
+    printf("  -o <file>       Write the sweep table to a file.\n");
+    printf("  -d <file>       Save the decoded trace; -t maps it directly next time.\n");
+    printf("  -O              Also report Belady OPT misses for the same geometry.\n");
+    printf("                  The sweep grid accepts p=opt as well.\n");
+    printf("  -C <file>[:<weight>[:<mask>]]\n");
+    printf("                  Co-run: interleave several traces (repeat -C) in one shared\n");
+    printf("                  data cache, <weight> accesses per round, filling only the ways\n");
+    printf("                  in <mask>. Reports per-trace misses against a solo run.\n");
+    printf("                  Takes only -s, -E, -b, -p and -w.\n");
+    printf("  -m <start>,<end> Keep only marker windows: from an access to hex address\n");
+    printf("                  <start> through an access to <end> (as in .marker)\n");
+    printf("  -r <lo>-<hi>    Keep only addresses in [lo, hi) (hex, repeatable)\n");
+    printf("  -x <lo>-<hi>    Drop addresses in [lo, hi) (hex, repeatable, hi may be empty)\n");
+    printf("  -f <ops>        Keep only these record types, e.g. LSM\n");
+    printf("  -W              With -m, simulate each window on a cold cache and print it\n");
+    printf("  -T <spec>       Timing model, e.g. \"dhit=4,ihit=1,penalty=100,mshr=8,rob=64\".\n");
+    printf("                  Reports AMAT and stall cycles; rob=1 models a blocking cache.\n");
+}
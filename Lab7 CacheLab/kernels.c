@@ -0,0 +1,935 @@
+/*
+ * kernels.c - Kernels for the other operations in cachelab.c (matrix
+ *     multiply, 5-point stencil, matrix-vector product, transposes of
+ *     1-, 2-, 4- and 8-byte elements, layout conversions in both
+ *     directions, in-place transposes and batched small-matrix
+ *     transposes).
+ *
+ * Each kernel has the prototype
+ * void kernel(int M, int N, const void *A, const void *X, void *Y);
+ * and is registered with the operation it implements, so tracegen
+ * validates it against that operation's reference and test-trans -K
+ * scores it on the same simulated cache as the transpose functions.
+ */
+#include <stdint.h>
+#include <immintrin.h>
+#include "cachelab.h"
+
+#define BLOCK_BYTES 32 /* block size the kernels are tiled for (b = 5) */
+#define MM_TILE 8 /* ints per 32-byte block */
+#define MV_ROWS 4 /* rows of A sharing one pass over X */
+
+/*
+ * matmul_naive - Inner-product order: X is walked down a column for
+ *     every element of Y
+ */
+char matmul_naive_desc[] = "Matrix multiply, inner-product order";
+void matmul_naive(int M, int N, const void *a, const void *x, void *y)
+{
+    const int *A = a, *X = x;
+    int *Y = y;
+    int i, j, k, sum;
+
+    for (i = 0; i < N; i++)
+    {
+        for (j = 0; j < N; j++)
+        {
+            sum = 0;
+            for (k = 0; k < M; k++)
+                sum += A[i * M + k] * X[k * N + j];
+            Y[i * N + j] = sum;
+        }
+    }
+}
+
+/*
+ * matmul_blocked - i-k-j order over MM_TILE x MM_TILE tiles of X, so
+ *     every block of X and Y is read along its row and reused while
+ *     it is still cached
+ */
+char matmul_blocked_desc[] = "Matrix multiply, blocked i-k-j";
+void matmul_blocked(int M, int N, const void *a, const void *x, void *y)
+{
+    const int *A = a, *X = x;
+    int *Y = y;
+    int i, j, k, kk, jj, kend, jend, aik;
+
+    /* A loop rather than memset, which is not instrumented */
+    for (i = 0; i < N * N; i++)
+        Y[i] = 0;
+    for (kk = 0; kk < M; kk += MM_TILE)
+    {
+        kend = kk + MM_TILE < M ? kk + MM_TILE : M;
+        for (jj = 0; jj < N; jj += MM_TILE)
+        {
+            jend = jj + MM_TILE < N ? jj + MM_TILE : N;
+            for (i = 0; i < N; i++)
+            {
+                for (k = kk; k < kend; k++)
+                {
+                    aik = A[i * M + k];
+                    for (j = jj; j < jend; j++)
+                        Y[i * N + j] += aik * X[k * N + j];
+                }
+            }
+        }
+    }
+}
+
+/*
+ * stencil_naive - Read all five neighbours of every element
+ */
+char stencil_naive_desc[] = "5-point stencil, direct";
+void stencil_naive(int M, int N, const void *a, const void *x, void *y)
+{
+    const int *A = a;
+    int *Y = y;
+    int i, j;
+
+    for (i = 0; i < N; i++)
+    {
+        for (j = 0; j < M; j++)
+        {
+            if (i == 0 || j == 0 || i == N - 1 || j == M - 1)
+                Y[i * M + j] = A[i * M + j];
+            else
+                Y[i * M + j] = A[i * M + j] + A[(i - 1) * M + j] +
+                               A[(i + 1) * M + j] + A[i * M + j - 1] +
+                               A[i * M + j + 1];
+        }
+    }
+}
+
+/*
+ * stencil_rolling - Keep the left and centre elements of the current
+ *     row in registers, so each row of A is loaded once per output row
+ *     it contributes to instead of three times
+ */
+char stencil_rolling_desc[] = "5-point stencil, rolling registers";
+void stencil_rolling(int M, int N, const void *a, const void *x, void *y)
+{
+    const int *A = a;
+    int *Y = y;
+    int i, j, left, mid, right;
+
+    for (j = 0; j < M; j++)
+        Y[j] = A[j];
+    for (i = 1; i < N - 1; i++)
+    {
+        left = A[i * M];
+        mid = A[i * M + 1];
+        Y[i * M] = left;
+        for (j = 1; j < M - 1; j++)
+        {
+            right = A[i * M + j + 1];
+            Y[i * M + j] = left + mid + right + A[(i - 1) * M + j] +
+                           A[(i + 1) * M + j];
+            left = mid;
+            mid = right;
+        }
+        if (M > 1)
+            Y[i * M + M - 1] = mid;
+    }
+    if (N > 1)
+        for (j = 0; j < M; j++)
+            Y[(N - 1) * M + j] = A[(N - 1) * M + j];
+}
+
+/*
+ * matvec_naive - One dot product per row
+ */
+char matvec_naive_desc[] = "Matrix-vector product, row dot products";
+void matvec_naive(int M, int N, const void *a, const void *x, void *y)
+{
+    const int *A = a, *X = x;
+    int *Y = y;
+    int i, j, sum;
+
+    for (i = 0; i < N; i++)
+    {
+        sum = 0;
+        for (j = 0; j < M; j++)
+            sum += A[i * M + j] * X[j];
+        Y[i] = sum;
+    }
+}
+
+/*
+ * matvec_rows - MV_ROWS dot products at once, so X is streamed through
+ *     the cache once per MV_ROWS rows instead of once per row
+ */
+char matvec_rows_desc[] = "Matrix-vector product, 4 rows per pass";
+void matvec_rows(int M, int N, const void *a, const void *x, void *y)
+{
+    const int *A = a, *X = x;
+    int *Y = y;
+    int i, j, xj, s0, s1, s2, s3;
+
+    for (i = 0; i + MV_ROWS <= N; i += MV_ROWS)
+    {
+        s0 = s1 = s2 = s3 = 0;
+        for (j = 0; j < M; j++)
+        {
+            xj = X[j];
+            s0 += A[i * M + j] * xj;
+            s1 += A[(i + 1) * M + j] * xj;
+            s2 += A[(i + 2) * M + j] * xj;
+            s3 += A[(i + 3) * M + j] * xj;
+        }
+        Y[i] = s0;
+        Y[i + 1] = s1;
+        Y[i + 2] = s2;
+        Y[i + 3] = s3;
+    }
+    for (; i < N; i++)
+    {
+        s0 = 0;
+        for (j = 0; j < M; j++)
+            s0 += A[i * M + j] * X[j];
+        Y[i] = s0;
+    }
+}
+
+/*
+ * TYPED_TRANSPOSE - Blocked transpose specialized for element type T.
+ *     A tile is one block of T wide (32 int8, 16 int16, 8 float or 4
+ *     double elements) and at least 16 rows tall, so the wide types
+ *     (float, double) get 16 rows and every row of B it writes covers
+ *     whole blocks. The tile is staged in a local buffer: all of its
+ *     rows of A are read before any row of B is written, and each row
+ *     of B is then written in one go. No block of A or B is needed again
+ *     after its tile, so B rows that alias in the cache (every 4 rows at
+ *     64 x 64 floats, every 2 for doubles) cannot cost a reload, which
+ *     is what the 4 x 8 staging of the int submission arranges by hand.
+ */
+#define TYPED_TRANSPOSE(name, T)                                           \
+char name##_desc[] = "Blocked transpose, " #T " elements";                 \
+void name(int M, int N, const void *a, const void *x, void *y)             \
+{                                                                          \
+    enum { COLS = BLOCK_BYTES / sizeof(T), ROWS = COLS > 16 ? COLS : 16 }; \
+    const T *A = a;                                                        \
+    T *B = y;                                                              \
+    T tile[ROWS][COLS];                                                    \
+    int i, j, r, c, rows, cols;                                            \
+                                                                           \
+    for (i = 0; i < N; i += ROWS)                                          \
+    {                                                                      \
+        rows = N - i < ROWS ? N - i : ROWS;                                \
+        for (j = 0; j < M; j += COLS)                                      \
+        {                                                                  \
+            cols = M - j < COLS ? M - j : COLS;                            \
+            for (r = 0; r < rows; r++)                                     \
+                for (c = 0; c < cols; c++)                                 \
+                    tile[r][c] = A[(i + r) * M + j + c];                   \
+            for (c = 0; c < cols; c++)                                     \
+                for (r = 0; r < rows; r++)                                 \
+                    B[(j + c) * N + i + r] = tile[r][c];                   \
+        }                                                                  \
+    }                                                                      \
+}
+
+TYPED_TRANSPOSE(transpose_int8, int8_t)
+TYPED_TRANSPOSE(transpose_int16, int16_t)
+TYPED_TRANSPOSE(transpose_float, float)
+TYPED_TRANSPOSE(transpose_double, double)
+
+/*
+ * to_tiled_naive - Row-major sweep, computing each element's tiled
+ *     position from scratch
+ */
+char to_tiled_naive_desc[] = "Row-major to tiled, per-element index";
+void to_tiled_naive(int M, int N, const void *a, const void *x, void *y)
+{
+    const int *A = a;
+    int *Y = y;
+    int i, j;
+
+    for (i = 0; i < N; i++)
+        for (j = 0; j < M; j++)
+            Y[tiledIndex(M, N, i, j)] = A[i * M + j];
+}
+
+/*
+ * to_tiled_rows - LAYOUT_STAGE tiles at a time: their rows of A are
+ *     read whole into a local buffer, then the tiles are written out
+ *     one after another, so every block of A and of Y is touched in
+ *     one go instead of A and Y taking turns and evicting each other.
+ *     A row of A that does not start on a block boundary shares a
+ *     block with the previous group; staging several tiles at a time
+ *     makes those blocks, which are re-read, that many times rarer.
+ */
+#define LAYOUT_STAGE 4 /* tiles staged at once: LAYOUT_TILE x 32 ints */
+char to_tiled_rows_desc[] = "Row-major to tiled, staged 8x32 strips";
+void to_tiled_rows(int M, int N, const void *a, const void *x, void *y)
+{
+    const int *A = a;
+    int *Y = y;
+    int stage[LAYOUT_TILE][LAYOUT_TILE * LAYOUT_STAGE];
+    int i, j, t, r, c, rows, cols, width;
+
+    for (i = 0; i < N; i += LAYOUT_TILE)
+    {
+        rows = N - i < LAYOUT_TILE ? N - i : LAYOUT_TILE;
+        for (j = 0; j < M; j += LAYOUT_TILE * LAYOUT_STAGE)
+        {
+            width = M - j < LAYOUT_TILE * LAYOUT_STAGE ? M - j : LAYOUT_TILE * LAYOUT_STAGE;
+            for (r = 0; r < rows; r++)
+                for (c = 0; c < width; c++)
+                    stage[r][c] = A[(i + r) * M + j + c];
+            for (t = 0; t < width; t += LAYOUT_TILE)
+            {
+                cols = width - t < LAYOUT_TILE ? width - t : LAYOUT_TILE;
+                for (r = 0; r < rows; r++)
+                    for (c = 0; c < cols; c++)
+                        Y[r * LAYOUT_TILE + c] = stage[r][t + c];
+                Y += LAYOUT_TILE * LAYOUT_TILE;
+            }
+        }
+    }
+}
+
+/*
+ * from_tiled_naive - Row-major sweep of Y, computing each element's
+ *     tiled position from scratch
+ */
+char from_tiled_naive_desc[] = "Tiled to row-major, per-element index";
+void from_tiled_naive(int M, int N, const void *a, const void *x, void *y)
+{
+    const int *A = a;
+    int *Y = y;
+    int i, j;
+
+    for (i = 0; i < N; i++)
+        for (j = 0; j < M; j++)
+            Y[i * M + j] = A[tiledIndex(M, N, i, j)];
+}
+
+/*
+ * from_tiled_rows - The inverse of to_tiled_rows: LAYOUT_STAGE tiles,
+ *     which are contiguous in A, are read into a local buffer, then
+ *     written to Y as LAYOUT_TILE row runs of up to 32 ints each
+ */
+char from_tiled_rows_desc[] = "Tiled to row-major, staged 8x32 strips";
+void from_tiled_rows(int M, int N, const void *a, const void *x, void *y)
+{
+    const int *A = a;
+    int *Y = y;
+    int stage[LAYOUT_TILE][LAYOUT_TILE * LAYOUT_STAGE];
+    int i, j, t, r, c, rows, cols, width;
+
+    for (i = 0; i < N; i += LAYOUT_TILE)
+    {
+        rows = N - i < LAYOUT_TILE ? N - i : LAYOUT_TILE;
+        for (j = 0; j < M; j += LAYOUT_TILE * LAYOUT_STAGE)
+        {
+            width = M - j < LAYOUT_TILE * LAYOUT_STAGE ? M - j : LAYOUT_TILE * LAYOUT_STAGE;
+            for (t = 0; t < width; t += LAYOUT_TILE)
+            {
+                cols = width - t < LAYOUT_TILE ? width - t : LAYOUT_TILE;
+                for (r = 0; r < rows; r++)
+                    for (c = 0; c < cols; c++)
+                        stage[r][t + c] = A[r * LAYOUT_TILE + c];
+                A += LAYOUT_TILE * LAYOUT_TILE;
+            }
+            for (r = 0; r < rows; r++)
+                for (c = 0; c < width; c++)
+                    Y[(i + r) * M + j + c] = stage[r][c];
+        }
+    }
+}
+
+/*
+ * to_morton_naive - Row-major sweep of A, computing each element's
+ *     Z-order position from scratch. A block of Y holds a 2 x 4 patch,
+ *     so each one is written on two different passes over a row
+ */
+char to_morton_naive_desc[] = "Row-major to Morton, per-element index";
+void to_morton_naive(int M, int N, const void *a, const void *x, void *y)
+{
+    const int *A = a;
+    int *Y = y;
+    int i, j;
+
+    for (i = 0; i < N; i++)
+        for (j = 0; j < M; j++)
+            Y[mortonIndex(i, j)] = A[i * M + j];
+}
+
+/*
+ * to_morton_patches - Two rows of A at a time, MORTON_STAGE columns at
+ *     a time: both row runs are read whole into a local buffer, then
+ *     written out as 2 x 4 patches, each exactly one 8-int block of Y.
+ *     Reading the runs first keeps rows i and i + 1 from evicting each
+ *     other when they alias in the cache (every row at 256 x 256).
+ *     Patches cut by the matrix edge go one element at a time.
+ */
+#define MORTON_STAGE 32 /* columns staged at once: 8 patches */
+char to_morton_patches_desc[] = "Row-major to Morton, staged 2x4 patches";
+void to_morton_patches(int M, int N, const void *a, const void *x, void *y)
+{
+    const int *A = a;
+    int *Y = y, *p;
+    int stage[2][MORTON_STAGE];
+    int i, j, r, c, k, rows, width;
+
+    for (i = 0; i < N; i += 2)
+    {
+        rows = N - i < 2 ? N - i : 2;
+        for (j = 0; j < M; j += MORTON_STAGE)
+        {
+            width = M - j < MORTON_STAGE ? M - j : MORTON_STAGE;
+            for (r = 0; r < rows; r++)
+                for (c = 0; c < width; c++)
+                    stage[r][c] = A[(i + r) * M + j + c];
+            for (c = 0; c < width; c += 4)
+            {
+                if (rows == 2 && c + 4 <= width)
+                {
+                    p = Y + mortonIndex(i, j + c);
+                    p[0] = stage[0][c];
+                    p[1] = stage[0][c + 1];
+                    p[2] = stage[1][c];
+                    p[3] = stage[1][c + 1];
+                    p[4] = stage[0][c + 2];
+                    p[5] = stage[0][c + 3];
+                    p[6] = stage[1][c + 2];
+                    p[7] = stage[1][c + 3];
+                    continue;
+                }
+                for (r = 0; r < rows; r++)
+                    for (k = c; k < c + 4 && k < width; k++)
+                        Y[mortonIndex(i + r, j + k)] = stage[r][k];
+            }
+        }
+    }
+}
+
+/*
+ * from_morton_naive - Row-major sweep of Y, computing each element's
+ *     Z-order position from scratch, so each block of A is read on two
+ *     different passes over a row
+ */
+char from_morton_naive_desc[] = "Morton to row-major, per-element index";
+void from_morton_naive(int M, int N, const void *a, const void *x, void *y)
+{
+    const int *A = a;
+    int *Y = y;
+    int i, j;
+
+    for (i = 0; i < N; i++)
+        for (j = 0; j < M; j++)
+            Y[i * M + j] = A[mortonIndex(i, j)];
+}
+
+/*
+ * from_morton_patches - The inverse of to_morton_patches: each 8-int
+ *     block of A is one 2 x 4 patch, read in one go into the local
+ *     buffer, and the two staged row runs are then written to Y
+ */
+char from_morton_patches_desc[] = "Morton to row-major, staged 2x4 patches";
+void from_morton_patches(int M, int N, const void *a, const void *x, void *y)
+{
+    const int *A = a, *p;
+    int *Y = y;
+    int stage[2][MORTON_STAGE];
+    int i, j, r, c, k, rows, width;
+
+    for (i = 0; i < N; i += 2)
+    {
+        rows = N - i < 2 ? N - i : 2;
+        for (j = 0; j < M; j += MORTON_STAGE)
+        {
+            width = M - j < MORTON_STAGE ? M - j : MORTON_STAGE;
+            for (c = 0; c < width; c += 4)
+            {
+                if (rows == 2 && c + 4 <= width)
+                {
+                    p = A + mortonIndex(i, j + c);
+                    stage[0][c] = p[0];
+                    stage[0][c + 1] = p[1];
+                    stage[1][c] = p[2];
+                    stage[1][c + 1] = p[3];
+                    stage[0][c + 2] = p[4];
+                    stage[0][c + 3] = p[5];
+                    stage[1][c + 2] = p[6];
+                    stage[1][c + 3] = p[7];
+                    continue;
+                }
+                for (r = 0; r < rows; r++)
+                    for (k = c; k < c + 4 && k < width; k++)
+                        stage[r][k] = A[mortonIndex(i + r, j + k)];
+            }
+            for (r = 0; r < rows; r++)
+                for (c = 0; c < width; c++)
+                    Y[(i + r) * M + j + c] = stage[r][c];
+        }
+    }
+}
+
+/*
+ * aos_to_soa_naive - One record at a time, so the AOS_FIELDS output
+ *     arrays are written in turn; when they are a multiple of the cache
+ *     size apart they keep evicting each other
+ */
+char aos_to_soa_naive_desc[] = "AoS to SoA, one record at a time";
+void aos_to_soa_naive(int M, int N, const void *a, const void *x, void *y)
+{
+    const int *A = a;
+    int *Y = y;
+    long r, R = (long)M * N / AOS_FIELDS;
+    int f;
+
+    for (r = 0; r < R; r++)
+        for (f = 0; f < AOS_FIELDS; f++)
+            Y[f * R + r] = A[r * AOS_FIELDS + f];
+}
+
+/*
+ * aos_to_soa_blocks - Load AOS_BATCH records, then write each field's
+ *     AOS_BATCH values as one run, so each output array is touched once
+ *     per block instead of once per element
+ */
+#define AOS_BATCH 8 /* records, so one 8-int block per field */
+char aos_to_soa_blocks_desc[] = "AoS to SoA, 8 records per field run";
+void aos_to_soa_blocks(int M, int N, const void *a, const void *x, void *y)
+{
+    const int *A = a;
+    int *Y = y;
+    long r, R = (long)M * N / AOS_FIELDS;
+    int f, k, batch[AOS_BATCH * AOS_FIELDS];
+
+    for (r = 0; r + AOS_BATCH <= R; r += AOS_BATCH)
+    {
+        for (k = 0; k < AOS_BATCH * AOS_FIELDS; k++)
+            batch[k] = A[r * AOS_FIELDS + k];
+        for (f = 0; f < AOS_FIELDS; f++)
+            for (k = 0; k < AOS_BATCH; k++)
+                Y[f * R + r + k] = batch[k * AOS_FIELDS + f];
+    }
+    for (; r < R; r++)
+        for (f = 0; f < AOS_FIELDS; f++)
+            Y[f * R + r] = A[r * AOS_FIELDS + f];
+}
+
+/*
+ * soa_to_aos_naive - One record at a time, so the AOS_FIELDS input
+ *     arrays are read in turn and evict each other the same way
+ */
+char soa_to_aos_naive_desc[] = "SoA to AoS, one record at a time";
+void soa_to_aos_naive(int M, int N, const void *a, const void *x, void *y)
+{
+    const int *A = a;
+    int *Y = y;
+    long r, R = (long)M * N / AOS_FIELDS;
+    int f;
+
+    for (r = 0; r < R; r++)
+        for (f = 0; f < AOS_FIELDS; f++)
+            Y[r * AOS_FIELDS + f] = A[f * R + r];
+}
+
+/*
+ * soa_to_aos_blocks - Read AOS_BATCH values of each field as one run,
+ *     then write the AOS_BATCH records back to back
+ */
+char soa_to_aos_blocks_desc[] = "SoA to AoS, 8 records per field run";
+void soa_to_aos_blocks(int M, int N, const void *a, const void *x, void *y)
+{
+    const int *A = a;
+    int *Y = y;
+    long r, R = (long)M * N / AOS_FIELDS;
+    int f, k, batch[AOS_BATCH * AOS_FIELDS];
+
+    for (r = 0; r + AOS_BATCH <= R; r += AOS_BATCH)
+    {
+        for (f = 0; f < AOS_FIELDS; f++)
+            for (k = 0; k < AOS_BATCH; k++)
+                batch[k * AOS_FIELDS + f] = A[f * R + r + k];
+        for (k = 0; k < AOS_BATCH * AOS_FIELDS; k++)
+            Y[r * AOS_FIELDS + k] = batch[k];
+    }
+    for (; r < R; r++)
+        for (f = 0; f < AOS_FIELDS; f++)
+            Y[r * AOS_FIELDS + f] = A[f * R + r];
+}
+
+/*
+ * follow_cycles - Transpose N-row Y of n + 1 elements in place by
+ *     following each permutation cycle from its smallest position, found
+ *     by walking the cycle first, so no extra memory is needed
+ */
+static void follow_cycles(int *Y, int N, long n)
+{
+    long k, p;
+    int v, t;
+
+    /* A[i][j] at k = i*M + j moves to j*N + i, which is k*N mod (MN - 1);
+       the first and last elements stay put */
+    for (k = 1; k < n; k++)
+    {
+        for (p = k * N % n; p > k; p = p * N % n)
+            ;
+        if (p < k)
+            continue; /* not the cycle's smallest position, already moved */
+        v = Y[k];
+        p = k;
+        do
+        {
+            p = p * N % n;
+            t = Y[p];
+            Y[p] = v;
+            v = t;
+        } while (p != k);
+    }
+}
+
+/*
+ * in_place_swaps - Square: swap each pair of mirrored elements. Other
+ *     shapes: follow_cycles
+ */
+char in_place_swaps_desc[] = "In-place transpose, element swaps / cycle leaders";
+void in_place_swaps(int M, int N, const void *a, const void *x, void *y)
+{
+    int *Y = y;
+    int i, j, t;
+
+    if (M == N)
+    {
+        for (i = 0; i < N; i++)
+            for (j = i + 1; j < N; j++)
+            {
+                t = Y[i * N + j];
+                Y[i * N + j] = Y[j * N + i];
+                Y[j * N + i] = t;
+            }
+        return;
+    }
+    follow_cycles(Y, N, (long)M * N - 1);
+}
+
+/*
+ * swap_tile_pair - Transpose the rows x cols tile of Y at (i, j) with
+ *     its mirror at (j, i). Both are loaded into small buffers, then
+ *     each is written back transposed into the other's place, row by
+ *     row, so every block of the pair is read once and written once.
+ *     A diagonal tile (i == j) is its own mirror.
+ */
+#define IP_TILE 8
+static inline void swap_tile_pair(int *Y, int N, int i, int j, int rows, int cols)
+{
+    int p[IP_TILE * IP_TILE], q[IP_TILE * IP_TILE];
+    int r, c;
+
+    for (r = 0; r < rows; r++)
+        for (c = 0; c < cols; c++)
+            p[r * IP_TILE + c] = Y[(i + r) * N + j + c];
+    if (i == j)
+    {
+        for (r = 0; r < rows; r++)
+            for (c = 0; c < cols; c++)
+                Y[(i + r) * N + j + c] = p[c * IP_TILE + r];
+        return;
+    }
+    for (c = 0; c < cols; c++)
+        for (r = 0; r < rows; r++)
+            q[c * IP_TILE + r] = Y[(j + c) * N + i + r];
+    for (c = 0; c < cols; c++)
+        for (r = 0; r < rows; r++)
+            Y[(j + c) * N + i + r] = p[r * IP_TILE + c];
+    for (r = 0; r < rows; r++)
+        for (c = 0; c < cols; c++)
+            Y[(i + r) * N + j + c] = q[c * IP_TILE + r];
+}
+
+/*
+ * in_place_tiles - Square: swap mirrored 8x8 tile pairs through small
+ *     buffers; full tiles call swap_tile_pair with constant bounds so it
+ *     is unrolled. Other shapes get no cache benefit: the cycles are
+ *     followed element by element in the same order as in_place_swaps,
+ *     so the misses are the same. A bitset of visited positions only
+ *     saves re-walking each cycle to find its leader, and is used up to
+ *     IP_BITSET elements; larger matrices fall back to follow_cycles.
+ */
+#define IP_BITSET (256 * 256) /* positions the visited bitset covers */
+char in_place_tiles_desc[] = "In-place transpose, 8x8 tile pairs (square only) / cycle bitset";
+void in_place_tiles(int M, int N, const void *a, const void *x, void *y)
+{
+    int *Y = y;
+    unsigned char visited[IP_BITSET / 8];
+    long k, d, n = (long)M * N - 1;
+    int i, j, rows, cols, v, t;
+
+    if (M != N && n + 1 > IP_BITSET)
+    {
+        follow_cycles(Y, N, n);
+        return;
+    }
+    if (M != N)
+    {
+        for (k = 0; k < (n + 8) / 8; k++)
+            visited[k] = 0;
+        for (k = 1; k < n; k++)
+        {
+            if (visited[k >> 3] & (1 << (k & 7)))
+                continue;
+            v = Y[k];
+            d = k;
+            do
+            {
+                d = d * N % n;
+                visited[d >> 3] |= 1 << (d & 7);
+                t = Y[d];
+                Y[d] = v;
+                v = t;
+            } while (d != k);
+        }
+        return;
+    }
+
+    for (i = 0; i < N; i += IP_TILE)
+    {
+        rows = N - i < IP_TILE ? N - i : IP_TILE;
+        for (j = i; j < N; j += IP_TILE)
+        {
+            cols = N - j < IP_TILE ? N - j : IP_TILE;
+            if (rows == IP_TILE && cols == IP_TILE)
+                swap_tile_pair(Y, N, i, j, IP_TILE, IP_TILE);
+            else
+                swap_tile_pair(Y, N, i, j, rows, cols);
+        }
+    }
+}
+
+/*
+ * transpose_one - Plain transpose of one small matrix, called through a
+ *     pointer by batch_per_call the way a trans_func_t is
+ */
+static void transpose_one(int M, int N, int A[N][M], int B[M][N])
+{
+    int i, j;
+    for (i = 0; i < N; i++)
+        for (j = 0; j < M; j++)
+            B[j][i] = A[i][j];
+}
+
+/*
+ * batch_per_call - One call per matrix: the baseline transposeBatch is
+ *     measured against. The loop over the tiny matrix is too short to
+ *     amortize the call, and the compiler cannot unroll across matrices
+ */
+char batch_per_call_desc[] = "Batched transpose, one call per matrix";
+void batch_per_call(int M, int N, const void *a, const void *x, void *y)
+{
+    void (*volatile one)(int, int, int[N][M], int[M][N]) = transpose_one;
+    const int *A = a;
+    int *Y = y;
+    long m, count = batchCount(M, N), size = (long)M * N;
+
+    for (m = 0; m < count; m++)
+        one(M, N, (int(*)[M])(A + m * size), (int(*)[N])(Y + m * size));
+}
+
+/*
+ * transpose4x4_sse - 4x4 block of ints at in (row stride is) to out
+ *     (row stride os) with SSE2 unpacks
+ */
+static inline void transpose4x4_sse(const int *in, int is, int *out, int os)
+{
+    __m128i r0, r1, r2, r3, t0, t1, t2, t3;
+
+    r0 = _mm_loadu_si128((const __m128i *)in);
+    r1 = _mm_loadu_si128((const __m128i *)(in + is));
+    r2 = _mm_loadu_si128((const __m128i *)(in + 2 * is));
+    r3 = _mm_loadu_si128((const __m128i *)(in + 3 * is));
+
+    t0 = _mm_unpacklo_epi32(r0, r1);
+    t1 = _mm_unpacklo_epi32(r2, r3);
+    t2 = _mm_unpackhi_epi32(r0, r1);
+    t3 = _mm_unpackhi_epi32(r2, r3);
+
+    _mm_storeu_si128((__m128i *)out, _mm_unpacklo_epi64(t0, t1));
+    _mm_storeu_si128((__m128i *)(out + os), _mm_unpackhi_epi64(t0, t1));
+    _mm_storeu_si128((__m128i *)(out + 2 * os), _mm_unpacklo_epi64(t2, t3));
+    _mm_storeu_si128((__m128i *)(out + 3 * os), _mm_unpackhi_epi64(t2, t3));
+}
+
+/*
+ * transpose4x4_pair_avx2 - Two consecutive 4x4 matrices at once, one
+ *     per 128-bit lane: each pair of rows is regrouped so row r of both
+ *     matrices shares a register, the lanes are transposed in place,
+ *     and the results are regrouped back into whole matrices
+ */
+__attribute__((target("avx2"))) static void transpose4x4_pair_avx2(const int *in, int *out)
+{
+    __m256i y0, y1, y2, y3, r0, r1, r2, r3, t0, t1, t2, t3;
+
+    y0 = _mm256_loadu_si256((const __m256i *)in);        /* rows 0-1 of the first */
+    y1 = _mm256_loadu_si256((const __m256i *)(in + 8));  /* rows 2-3 of the first */
+    y2 = _mm256_loadu_si256((const __m256i *)(in + 16)); /* rows 0-1 of the second */
+    y3 = _mm256_loadu_si256((const __m256i *)(in + 24)); /* rows 2-3 of the second */
+
+    r0 = _mm256_permute2x128_si256(y0, y2, 0x20);
+    r1 = _mm256_permute2x128_si256(y0, y2, 0x31);
+    r2 = _mm256_permute2x128_si256(y1, y3, 0x20);
+    r3 = _mm256_permute2x128_si256(y1, y3, 0x31);
+
+    t0 = _mm256_unpacklo_epi32(r0, r1);
+    t1 = _mm256_unpackhi_epi32(r0, r1);
+    t2 = _mm256_unpacklo_epi32(r2, r3);
+    t3 = _mm256_unpackhi_epi32(r2, r3);
+
+    r0 = _mm256_unpacklo_epi64(t0, t2); /* column 0 of both */
+    r1 = _mm256_unpackhi_epi64(t0, t2);
+    r2 = _mm256_unpacklo_epi64(t1, t3);
+    r3 = _mm256_unpackhi_epi64(t1, t3);
+
+    _mm256_storeu_si256((__m256i *)out, _mm256_permute2x128_si256(r0, r1, 0x20));
+    _mm256_storeu_si256((__m256i *)(out + 8), _mm256_permute2x128_si256(r2, r3, 0x20));
+    _mm256_storeu_si256((__m256i *)(out + 16), _mm256_permute2x128_si256(r0, r1, 0x31));
+    _mm256_storeu_si256((__m256i *)(out + 24), _mm256_permute2x128_si256(r2, r3, 0x31));
+}
+
+/*
+ * transpose8x8_avx2 - 8x8 block of ints at in (row stride is) to out
+ *     (row stride os): 4x4 transposes inside each lane, then the lanes
+ *     are swapped with permutes, as in trans_simd
+ */
+__attribute__((target("avx2"))) static void transpose8x8_avx2(const int *in, int is, int *out, int os)
+{
+    __m256i r0, r1, r2, r3, r4, r5, r6, r7;
+    __m256i t0, t1, t2, t3, t4, t5, t6, t7;
+
+    r0 = _mm256_loadu_si256((const __m256i *)in);
+    r1 = _mm256_loadu_si256((const __m256i *)(in + is));
+    r2 = _mm256_loadu_si256((const __m256i *)(in + 2 * is));
+    r3 = _mm256_loadu_si256((const __m256i *)(in + 3 * is));
+    r4 = _mm256_loadu_si256((const __m256i *)(in + 4 * is));
+    r5 = _mm256_loadu_si256((const __m256i *)(in + 5 * is));
+    r6 = _mm256_loadu_si256((const __m256i *)(in + 6 * is));
+    r7 = _mm256_loadu_si256((const __m256i *)(in + 7 * is));
+
+    t0 = _mm256_unpacklo_epi32(r0, r1);
+    t1 = _mm256_unpackhi_epi32(r0, r1);
+    t2 = _mm256_unpacklo_epi32(r2, r3);
+    t3 = _mm256_unpackhi_epi32(r2, r3);
+    t4 = _mm256_unpacklo_epi32(r4, r5);
+    t5 = _mm256_unpackhi_epi32(r4, r5);
+    t6 = _mm256_unpacklo_epi32(r6, r7);
+    t7 = _mm256_unpackhi_epi32(r6, r7);
+
+    r0 = _mm256_unpacklo_epi64(t0, t2);
+    r1 = _mm256_unpackhi_epi64(t0, t2);
+    r2 = _mm256_unpacklo_epi64(t1, t3);
+    r3 = _mm256_unpackhi_epi64(t1, t3);
+    r4 = _mm256_unpacklo_epi64(t4, t6);
+    r5 = _mm256_unpackhi_epi64(t4, t6);
+    r6 = _mm256_unpacklo_epi64(t5, t7);
+    r7 = _mm256_unpackhi_epi64(t5, t7);
+
+    _mm256_storeu_si256((__m256i *)out, _mm256_permute2x128_si256(r0, r4, 0x20));
+    _mm256_storeu_si256((__m256i *)(out + os), _mm256_permute2x128_si256(r1, r5, 0x20));
+    _mm256_storeu_si256((__m256i *)(out + 2 * os), _mm256_permute2x128_si256(r2, r6, 0x20));
+    _mm256_storeu_si256((__m256i *)(out + 3 * os), _mm256_permute2x128_si256(r3, r7, 0x20));
+    _mm256_storeu_si256((__m256i *)(out + 4 * os), _mm256_permute2x128_si256(r0, r4, 0x31));
+    _mm256_storeu_si256((__m256i *)(out + 5 * os), _mm256_permute2x128_si256(r1, r5, 0x31));
+    _mm256_storeu_si256((__m256i *)(out + 6 * os), _mm256_permute2x128_si256(r2, r6, 0x31));
+    _mm256_storeu_si256((__m256i *)(out + 7 * os), _mm256_permute2x128_si256(r3, r7, 0x31));
+}
+
+/*
+ * transposeBatch - Transpose count rows x cols int matrices stored one
+ *     after another in in, writing the cols x rows results one after
+ *     another in out. The shape and CPU are checked once per batch, not
+ *     per matrix: 4x4 goes two matrices per AVX2 iteration, multiples
+ *     of 8 (8x8, 16x16, ...) in 8x8 AVX2 blocks, multiples of 4 in SSE2
+ *     4x4 blocks two matrices at a time, and anything else element by
+ *     element.
+ */
+void transposeBatch(int rows, int cols, long count, const int *in, int *out)
+{
+    long m, size = (long)rows * cols;
+    int i, j, avx2 = __builtin_cpu_supports("avx2");
+
+    if (rows == 4 && cols == 4 && avx2)
+    {
+        for (m = 0; m + 2 <= count; m += 2)
+            transpose4x4_pair_avx2(in + m * 16, out + m * 16);
+        if (m < count)
+            transpose4x4_sse(in + m * 16, 4, out + m * 16, 4);
+    }
+    else if (rows % 8 == 0 && cols % 8 == 0 && avx2)
+    {
+        for (m = 0; m < count; m++)
+            for (i = 0; i < rows; i += 8)
+                for (j = 0; j < cols; j += 8)
+                    transpose8x8_avx2(in + m * size + i * cols + j, cols,
+                                      out + m * size + j * rows + i, rows);
+    }
+    else if (rows % 4 == 0 && cols % 4 == 0)
+    {
+        for (m = 0; m + 2 <= count; m += 2)
+            for (i = 0; i < rows; i += 4)
+                for (j = 0; j < cols; j += 4)
+                {
+                    transpose4x4_sse(in + m * size + i * cols + j, cols,
+                                     out + m * size + j * rows + i, rows);
+                    transpose4x4_sse(in + (m + 1) * size + i * cols + j, cols,
+                                     out + (m + 1) * size + j * rows + i, rows);
+                }
+        for (; m < count; m++)
+            for (i = 0; i < rows; i += 4)
+                for (j = 0; j < cols; j += 4)
+                    transpose4x4_sse(in + m * size + i * cols + j, cols,
+                                     out + m * size + j * rows + i, rows);
+    }
+    else
+    {
+        for (m = 0; m < count; m++, in += size, out += size)
+            for (i = 0; i < rows; i++)
+                for (j = 0; j < cols; j++)
+                    out[j * rows + i] = in[i * cols + j];
+    }
+}
+
+/*
+ * batch_simd - The whole batch in one transposeBatch call
+ */
+char batch_simd_desc[] = "Batched transpose, transposeBatch (AVX2/SSE2)";
+void batch_simd(int M, int N, const void *a, const void *x, void *y)
+{
+    transposeBatch(N, M, batchCount(M, N), a, y);
+}
+
+/*
+ * registerKernels - Register the kernels above after the transpose
+ *     functions, with the operation each one implements
+ */
+void registerKernels()
+{
+    registerKernel(&matmulOp, matmul_naive, matmul_naive_desc);
+    registerKernel(&matmulOp, matmul_blocked, matmul_blocked_desc);
+    registerKernel(&stencilOp, stencil_naive, stencil_naive_desc);
+    registerKernel(&stencilOp, stencil_rolling, stencil_rolling_desc);
+    registerKernel(&matvecOp, matvec_naive, matvec_naive_desc);
+    registerKernel(&matvecOp, matvec_rows, matvec_rows_desc);
+    registerKernel(&transposeInt8Op, transpose_int8, transpose_int8_desc);
+    registerKernel(&transposeInt16Op, transpose_int16, transpose_int16_desc);
+    registerKernel(&transposeFloatOp, transpose_float, transpose_float_desc);
+    registerKernel(&transposeDoubleOp, transpose_double, transpose_double_desc);
+    registerKernel(&toTiledOp, to_tiled_naive, to_tiled_naive_desc);
+    registerKernel(&toTiledOp, to_tiled_rows, to_tiled_rows_desc);
+    registerKernel(&fromTiledOp, from_tiled_naive, from_tiled_naive_desc);
+    registerKernel(&fromTiledOp, from_tiled_rows, from_tiled_rows_desc);
+    registerKernel(&toMortonOp, to_morton_naive, to_morton_naive_desc);
+    registerKernel(&toMortonOp, to_morton_patches, to_morton_patches_desc);
+    registerKernel(&fromMortonOp, from_morton_naive, from_morton_naive_desc);
+    registerKernel(&fromMortonOp, from_morton_patches, from_morton_patches_desc);
+    registerKernel(&aosToSoaOp, aos_to_soa_naive, aos_to_soa_naive_desc);
+    registerKernel(&aosToSoaOp, aos_to_soa_blocks, aos_to_soa_blocks_desc);
+    registerKernel(&soaToAosOp, soa_to_aos_naive, soa_to_aos_naive_desc);
+    registerKernel(&soaToAosOp, soa_to_aos_blocks, soa_to_aos_blocks_desc);
+    registerKernel(&inPlaceTransposeOp, in_place_swaps, in_place_swaps_desc);
+    registerKernel(&inPlaceTransposeOp, in_place_tiles, in_place_tiles_desc);
+    registerKernel(&batchTransposeOp, batch_per_call, batch_per_call_desc);
+    registerKernel(&batchTransposeOp, batch_simd, batch_simd_desc);
+}
@@ -3,6 +3,7 @@
  *     student's transpose functions and records the results for their
  *     official submitted version as well.
  */
+#define _GNU_SOURCE // for syscall
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -11,9 +12,16 @@
 #include <signal.h>
 #include <getopt.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #include "cachelab.h"
 #include <sys/wait.h> // fir WEXITSTATUS
 #include <limits.h>   // for INT_MAX
+#include <time.h>
+#include <x86intrin.h> // for __rdtsc
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
 
 /* Maximum array dimension */
 #define MAXN 256
@@ -22,8 +30,9 @@
    student submits for credit */
 #define SUBMIT_DESCRIPTION "Transpose submission"
 
-/* External function defined in trans.c */
+/* External functions defined in trans.c and kernels.c */
 extern void registerFunctions();
+extern void registerKernels();
 
 /* External variables defined in cachelab-tools.c */
 extern trans_func_t func_list[MAX_TRANS_FUNCS];
@@ -32,6 +41,38 @@ extern int func_counter;
 /* Globals set on the command line */
 static int M = 0;
 static int N = 0;
+static int use_lackey = 0;   /* -L: trace with valgrind instead of tracegen-instr */
+static int check_lackey = 0; /* -V: also run valgrind and compare the counts */
+static int jobs = 1;         /* -j: functions evaluated at once */
+static int bench_runs = 0;   /* -B: timed runs per function, 0 = no benchmark */
+static int perf_counters = 0; /* -P: read hardware counters around each function */
+static int kernels = 0;       /* -K: also evaluate the kernels in kernels.c */
+static int robust = 0;        /* -R: also score every function on several caches */
+static int quiet = 0;         /* no progress lines while -R sweeps the caches */
+static char *heatmap = NULL;  /* -H: conflict heatmap file written by tracegen-instr */
+static unsigned long long seed = DEFAULT_SEED; /* -S: seed of every input, passed to tracegen */
+
+/* A cache shape scored by -R */
+struct geometry
+{
+    unsigned int s, E, b;
+    const char *name;
+};
+
+/* The lab's cache, a few neighbours of it, and L1d/L2-like shapes */
+#define MAX_GEOMETRIES 16
+static struct geometry geometries[MAX_GEOMETRIES] = {
+    {5, 1, 5, "1KB direct-mapped, 32B blocks (lab)"},
+    {5, 2, 5, "2KB 2-way, 32B blocks"},
+    {4, 4, 5, "2KB 4-way, 32B blocks"},
+    {4, 1, 6, "1KB direct-mapped, 64B blocks"},
+    {6, 8, 6, "32KB 8-way, 64B blocks (L1d)"},
+    {10, 4, 6, "256KB 4-way, 64B blocks (L2)"},
+};
+static int num_geometries = 6;
+
+/* Directory holding tracegen, tracegen-instr and csim-ref */
+static const char *bindir = ".";
 
 /* The correctness and performance for the submitted transpose function */
 struct results
@@ -42,127 +83,615 @@ struct results
 };
 static struct results results = {-1, 0, INT_MAX};
 
+/*
+ * read_results - Read the hits, misses and evictions left by printSummary
+ */
+static void read_results(unsigned int *hits, unsigned int *misses,
+                         unsigned int *evictions)
+{
+    FILE *in_fp = fopen(".csim_results", "r");
+    assert(in_fp);
+    fscanf(in_fp, "%u %u %u", hits, misses, evictions);
+    fclose(in_fp);
+}
+
+/*
+ * trace_lackey - Trace function i under valgrind and simulate the part
+ *     between the markers with csim-ref, streaming: lackey's output is
+ *     read from a pipe, filtered as it arrives and written straight into
+ *     a second pipe to csim-ref, so no trace ever touches the disk.
+ *     Returns the exit status of tracegen (nonzero if the function is
+ *     incorrect).
+ */
+static int trace_lackey(int i, unsigned int s, unsigned int E, unsigned int b,
+                        unsigned int *hits, unsigned int *misses,
+                        unsigned int *evictions)
+{
+    int flag, markers = 0;
+    unsigned long long int marker_start = 0, marker_end = 0, addr;
+    char buf[1000], cmd[255];
+    FILE *valgrind_fp;
+    FILE *csim_fp;
+
+    if (!quiet)
+    {
+        printf("Step 1: Validating and generating memory traces\n");
+        printf("Step 2: Evaluating performance (s=%d, E=%d, b=%d)\n", s, E, b);
+    }
+    fflush(stdout);
+
+    /* Both ends run at once: valgrind produces, csim-ref consumes */
+    sprintf(cmd, "valgrind --tool=lackey --trace-mem=yes --log-fd=1 -v %s/tracegen -M %d -N %d -F %d -S %llu%s",
+            bindir, M, N, i, seed, kernels ? " -K" : "");
+    valgrind_fp = popen(cmd, "r");
+    assert(valgrind_fp);
+    sprintf(cmd, "%s/csim-ref -s %u -E %u -b %u -t /dev/stdin > /dev/null",
+            bindir, s, E, b);
+    csim_fp = popen(cmd, "w");
+    assert(csim_fp);
+    setvbuf(valgrind_fp, NULL, _IOFBF, 1 << 20);
+    setvbuf(csim_fp, NULL, _IOFBF, 1 << 20);
+
+    /* Locate trace corresponding to the trans function */
+    flag = 0;
+    while (fgets(buf, 1000, valgrind_fp) != NULL)
+    {
+        /* tracegen prints the marker addresses before running anything */
+        if (!markers)
+        {
+            markers = sscanf(buf, "MARKERS %llx %llx", &marker_start, &marker_end) == 2;
+            continue;
+        }
+
+        /* We are only interested in memory access instructions */
+        if (buf[0] == ' ' && buf[2] == ' ' &&
+            (buf[1] == 'S' || buf[1] == 'M' || buf[1] == 'L'))
+        {
+            addr = strtoull(buf + 3, NULL, 16);
+
+            /* If start marker found, set flag */
+            if (addr == marker_start)
+                flag = 1;
+
+            /* Valgrind creates many spurious accesses to the
+               stack that have nothing to do with the students
+               code. At the moment, we are ignoring all stack
+               accesses by using the simple filter of recording
+               accesses to only the low 32-bit portion of the
+               address space. At some point it would be nice to
+               try to do more informed filtering so that would
+               eliminate the valgrind stack references while
+               include the student stack references. */
+            if (flag && addr < 0xffffffff)
+            {
+                fputs(buf, csim_fp);
+            }
+
+            /* if end marker found, the rest is validation */
+            if (addr == marker_end)
+            {
+                flag = 0;
+                break;
+            }
+        }
+    }
+
+    /* csim-ref has the whole region; let it finish while valgrind does */
+    pclose(csim_fp);
+    while (fread(buf, 1, sizeof(buf), valgrind_fp) > 0)
+        ;
+    flag = WEXITSTATUS(pclose(valgrind_fp));
+    if (0 != flag)
+        return flag;
+
+    /* Collect results from the reference simulator */
+    read_results(hits, misses, evictions);
+    return 0;
+}
+
+/*
+ * trace_instrumented - Run function i in tracegen-instr, whose
+ *     instrumented copy of trans.c feeds every load and store straight
+ *     into an embedded simulator. Returns the exit status of tracegen.
+ */
+static int trace_instrumented(int i, unsigned int s, unsigned int E, unsigned int b,
+                              unsigned int *hits, unsigned int *misses,
+                              unsigned int *evictions)
+{
+    int flag;
+    char cmd[PATH_MAX + 255]; /* room for the -H path */
+
+    if (!quiet)
+        printf("Step 1: Validating and simulating in-process (s=%d, E=%d, b=%d)\n", s, E, b);
+    /* The heatmap is for the graded geometry, not the -R sweep */
+    sprintf(cmd, "%s/tracegen-instr -M %d -N %d -F %d -S %llu -s %u -E %u -b %u%s%s%s > /dev/null",
+            bindir, M, N, i, seed, s, E, b, kernels ? " -K" : "",
+            heatmap && !quiet ? " -H " : "", heatmap && !quiet ? heatmap : "");
+    flag = WEXITSTATUS(system(cmd));
+    if (0 != flag)
+        return flag;
+    read_results(hits, misses, evictions);
+    return 0;
+}
+
+/*
+ * eval_func - Validate function i, simulate it and print its results
+ */
+static void eval_func(int i, unsigned int s, unsigned int E, unsigned int b)
+{
+    int flag;
+    unsigned int hits, misses, evictions;
+    unsigned int lackey_hits, lackey_misses, lackey_evictions;
+
+    printf("\nFunction %d (%d total)\n", i, func_counter);
+    if (use_lackey)
+        flag = trace_lackey(i, s, E, b, &hits, &misses, &evictions);
+    else
+        flag = trace_instrumented(i, s, E, b, &hits, &misses, &evictions);
+    if (0 != flag)
+    {
+        printf("Validation error at function %d! Run ./tracegen -M %d -N %d -F %d -S %llu%s for details.\nSkipping performance evaluation for this function.\n", flag - 1, M, N, i, seed, kernels ? " -K" : "");
+        return;
+    }
+
+    func_list[i].correct = 1;
+    func_list[i].num_hits = hits;
+    func_list[i].num_misses = misses;
+    func_list[i].num_evictions = evictions;
+    printf("func %u (%s): hits:%u, misses:%u, evictions:%u\n",
+           i, func_list[i].description, hits, misses, evictions);
+
+    /* Cross-check the in-process counts against the valgrind path */
+    if (check_lackey && !use_lackey &&
+        (flag = trace_lackey(i, s, E, b, &lackey_hits, &lackey_misses, &lackey_evictions)) != 0)
+    {
+        printf("lackey %u: tracegen under valgrind exited with %d\n", i, flag);
+    }
+    else if (check_lackey && !use_lackey)
+    {
+        printf("lackey %u (%s): hits:%u, misses:%u, evictions:%u (%s)\n",
+               i, func_list[i].description, lackey_hits, lackey_misses,
+               lackey_evictions,
+               (hits == lackey_hits && misses == lackey_misses &&
+                evictions == lackey_evictions) ? "match" : "MISMATCH");
+    }
+}
+
+/*
+ * eval_parallel - Run eval_func for up to jobs functions at once. Each
+ *     one runs in a child process inside its own trans.d<i> directory,
+ *     so trace.tmp, .marker and .csim_results are never shared. The
+ *     children's output is printed afterwards in function order, so the
+ *     summary reads exactly as in a serial run.
+ */
+static void eval_parallel(unsigned int s, unsigned int E, unsigned int b, int jobs)
+{
+    int i, next = 0, running = 0, correct;
+    char dir[64], path[128], buf[1000];
+    FILE *fp;
+    size_t n;
+
+    fflush(stdout);
+    while (next < func_counter || running > 0)
+    {
+        if (next < func_counter && running < jobs)
+        {
+            sprintf(dir, "trans.d%d", next);
+            mkdir(dir, 0755);
+            /* The directory may be left from an earlier run: a child that
+               dies before writing must not leave its old score behind */
+            sprintf(path, "%s/result", dir);
+            unlink(path);
+            sprintf(path, "%s/.csim_results", dir);
+            unlink(path);
+            sprintf(path, "%s/log", dir);
+            unlink(path);
+            if (fork() == 0)
+            {
+                if (chdir(dir) != 0 || freopen("log", "w", stdout) == NULL)
+                    exit(1);
+                bindir = "..";
+                eval_func(next, s, E, b);
+                fp = fopen("result", "w");
+                assert(fp);
+                fprintf(fp, "%d %u %u %u\n", func_list[next].correct,
+                        func_list[next].num_hits, func_list[next].num_misses,
+                        func_list[next].num_evictions);
+                fclose(fp);
+                exit(0);
+            }
+            running++;
+            next++;
+            continue;
+        }
+        wait(NULL);
+        running--;
+    }
+
+    for (i = 0; i < func_counter; i++)
+    {
+        sprintf(path, "trans.d%d/log", i);
+        if ((fp = fopen(path, "r")) != NULL)
+        {
+            while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+                fwrite(buf, 1, n, stdout);
+            fclose(fp);
+        }
+        sprintf(path, "trans.d%d/result", i);
+        if ((fp = fopen(path, "r")) == NULL)
+        {
+            printf("\nFunction %d: evaluation did not finish\n", i);
+            continue;
+        }
+        if (fscanf(fp, "%d %u %u %u", &correct, &func_list[i].num_hits,
+                   &func_list[i].num_misses, &func_list[i].num_evictions) == 4)
+            func_list[i].correct = correct;
+        fclose(fp);
+    }
+}
+
 /* 
  * eval_perf - Evaluate the performance of the registered transpose functions
  */
-void eval_perf(unsigned int s, unsigned int E, unsigned int b)
+void eval_perf(unsigned int s, unsigned int E, unsigned int b, int jobs)
 {
-    int i, flag;
-    unsigned int len, hits, misses, evictions;
-    unsigned long long int marker_start, marker_end, addr;
-    char buf[1000], cmd[255];
-    char filename[128];
+    int i;
 
     registerFunctions();
-
-    /* Open the complete trace file */
-    FILE *full_trace_fp;
-    FILE *part_trace_fp;
+    if (kernels)
+        registerKernels();
 
     /* Evaluate the performance of each registered transpose function */
+    if (jobs > 1 && func_counter > 1)
+        eval_parallel(s, E, b, jobs);
+    else
+        for (i = 0; i < func_counter; i++)
+            eval_func(i, s, E, b);
 
     for (i = 0; i < func_counter; i++)
     {
         if (strcmp(func_list[i].description, SUBMIT_DESCRIPTION) == 0)
             results.funcid = i; /* remember which function is the submission */
 
-        printf("\nFunction %d (%d total)\nStep 1: Validating and generating memory traces\n", i, func_counter);
-        /* Use valgrind to generate the trace */
-
-        sprintf(cmd, "valgrind --tool=lackey --trace-mem=yes --log-fd=1 -v ./tracegen -M %d -N %d -F %d  > trace.tmp", M, N, i);
-        flag = WEXITSTATUS(system(cmd));
-        if (0 != flag)
+        /* Save the correctness and misses of the transpose submission */
+        if (results.funcid == i && func_list[i].correct)
         {
-            printf("Validation error at function %d! Run ./tracegen -M %d -N %d -F %d for details.\nSkipping performance evaluation for this function.\n", flag - 1, M, N, i);
-            continue;
+            results.correct = 1;
+            results.misses = func_list[i].num_misses;
         }
+    }
+}
+
+/*
+ * parse_geometries - Replace the -R list with "s:E:b[,s:E:b...]"
+ */
+static int parse_geometries(char *list)
+{
+    char *tok;
+
+    num_geometries = 0;
+    for (tok = strtok(list, ","); tok != NULL; tok = strtok(NULL, ","))
+    {
+        if (num_geometries == MAX_GEOMETRIES ||
+            sscanf(tok, "%u:%u:%u", &geometries[num_geometries].s,
+                   &geometries[num_geometries].E,
+                   &geometries[num_geometries].b) != 3 ||
+            geometries[num_geometries].E == 0)
+            return 0;
+        geometries[num_geometries].name = "";
+        num_geometries++;
+    }
+    return num_geometries > 0;
+}
 
-        /* Get the start and end marker addresses */
-        FILE *marker_fp = fopen(".marker", "r");
-        assert(marker_fp);
-        fscanf(marker_fp, "%llx %llx", &marker_start, &marker_end);
-        fclose(marker_fp);
+/*
+ * eval_robust - Simulate every correct function on every cache in
+ *     geometries and print its miss ratio (misses / accesses) on each,
+ *     then the worst and the mean, so a function tuned to the lab's
+ *     1KB direct-mapped cache alone shows up by its worst case
+ */
+static void eval_robust(void)
+{
+    int i, g, worst_g, scored;
+    unsigned int hits, misses, evictions;
+    double ratio, worst, sum;
 
-        func_list[i].correct = 1;
+    printf("\nMiss ratio on %d cache geometries (misses / accesses)\n", num_geometries);
+    for (g = 0; g < num_geometries; g++)
+        printf("  g%d: s=%u E=%u b=%u  %s\n", g, geometries[g].s,
+               geometries[g].E, geometries[g].b, geometries[g].name);
 
-        /* Save the correctness of the transpose submission */
-        if (results.funcid == i)
+    quiet = 1;
+    for (i = 0; i < func_counter; i++)
+    {
+        if (!func_list[i].correct)
+            continue;
+        printf("robust %d (%s):", i, func_list[i].description);
+        worst = -1;
+        worst_g = 0;
+        sum = 0;
+        scored = 0;
+        for (g = 0; g < num_geometries; g++)
         {
-            results.correct = 1;
+            if ((use_lackey ? trace_lackey(i, geometries[g].s, geometries[g].E,
+                                           geometries[g].b, &hits, &misses, &evictions)
+                            : trace_instrumented(i, geometries[g].s, geometries[g].E,
+                                                 geometries[g].b, &hits, &misses, &evictions)) != 0)
+            {
+                printf(" g%d:failed", g);
+                continue;
+            }
+            ratio = hits + misses ? (double)misses / (hits + misses) : 0;
+            printf(" g%d:%.4f", g, ratio);
+            sum += ratio;
+            scored++;
+            if (ratio > worst)
+            {
+                worst = ratio;
+                worst_g = g;
+            }
         }
+        if (scored > 0)
+            printf(", worst:%.4f (g%d), mean:%.4f", worst, worst_g, sum / scored);
+        printf("\n");
+        fflush(stdout);
+    }
+    quiet = 0;
+}
+
+/* Matrices for the wall-clock benchmark, aligned for the SIMD kernels
+   and wide enough for kernels with 8-byte elements */
+static int bench_A[2 * MAXN * MAXN] __attribute__((aligned(64)));
+static int bench_B[2 * MAXN * MAXN] __attribute__((aligned(64)));
+static int bench_C[2 * MAXN * MAXN] __attribute__((aligned(64)));
+static int bench_D[2 * MAXN * MAXN] __attribute__((aligned(64)));
+
+/*
+ * bench_setup - Fill the benchmark inputs for function i and put the
+ *     correct result in bench_C. A transpose reads bench_A and writes
+ *     bench_B; a kernel reads bench_A and bench_D and writes bench_B.
+ *     An in-place kernel works on bench_B alone, starting from a copy
+ *     of bench_A.
+ */
+static int in_place_turns; /* calls made on bench_B since bench_setup */
 
-        full_trace_fp = fopen("trace.tmp", "r");
-        assert(full_trace_fp);
+static void bench_setup(int i)
+{
+    const kernel_op_t *op = func_list[i].op;
 
-        /* Filtered trace for each transpose function goes in a separate file */
-        sprintf(filename, "trace.f%d", i);
-        part_trace_fp = fopen(filename, "w");
-        assert(part_trace_fp);
+    in_place_turns = 0;
+    if (op == NULL)
+    {
+        initMatrix(M, N, (int (*)[M])bench_A, (int (*)[N])bench_B);
+        correctTrans(M, N, (int (*)[M])bench_A, (int (*)[N])bench_C);
+        return;
+    }
+    op->init(M, N, bench_A, bench_D);
+    op->reference(M, N, bench_A, bench_D, bench_C);
+    if (op->in_place)
+        memcpy(bench_B, bench_A, (size_t)M * N * op->elem_size);
+}
 
-        /* Locate trace corresponding to the trans function */
-        flag = 0;
-        while (fgets(buf, 1000, full_trace_fp) != NULL)
+/*
+ * bench_call - Call function i once on the benchmark buffers
+ */
+static inline void bench_call(int i)
+{
+    /* Repeated in-place calls transpose bench_B back and forth, so
+       every other call sees the N x M shape */
+    if (func_list[i].op && func_list[i].op->in_place && in_place_turns++ % 2)
+        (*func_list[i].kernel_ptr)(N, M, bench_A, bench_D, bench_B);
+    else if (func_list[i].op)
+        (*func_list[i].kernel_ptr)(M, N, bench_A, bench_D, bench_B);
+    else
+        (*func_list[i].func_ptr)(M, N, (int (*)[M])bench_A, (int (*)[N])bench_B);
+}
+
+/*
+ * bench_correct - Whether function i left the correct result in bench_B
+ */
+static int bench_correct(int i)
+{
+    /* After an even number of calls bench_B is back to A, so check a
+       single call from scratch instead */
+    if (func_list[i].op && func_list[i].op->in_place)
+    {
+        bench_setup(i);
+        bench_call(i);
+    }
+    if (func_list[i].op)
+        return func_list[i].op->validate(M, N, bench_B, bench_C) < 0;
+    return memcmp(bench_B, bench_C, sizeof(int) * M * N) == 0;
+}
+
+#define BENCH_WARMUP 3       /* untimed calls before measuring */
+#define BENCH_MIN_NS 1000000 /* a timed run repeats the call for at least 1 ms */
+
+/*
+ * now_ns - Monotonic wall-clock time in nanoseconds
+ */
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/*
+ * bench_perf - Time every registered function natively (compiled with
+ *     -O2) and print the best of runs timed runs as GB/s (bytes read
+ *     plus bytes written) and TSC cycles per element, next to the
+ *     simulated misses
+ */
+static void bench_perf(int runs)
+{
+    int i, k, r, iters;
+    double t0, ns, best;
+    unsigned long long c0, cycles, best_cycles = 0;
+    long bytes;
+    int elem_size;
+
+    printf("\nBenchmark %dx%d, seed %llu (best of %d runs after %d warm-up calls)\n",
+           M, N, seed, runs, BENCH_WARMUP);
+    for (i = 0; i < func_counter; i++)
+    {
+        bench_setup(i);
+        for (k = 0; k < BENCH_WARMUP; k++)
+            bench_call(i);
+
+        /* Double the calls per run until one run is long enough to time */
+        for (iters = 1; iters < (1 << 20); iters *= 2)
         {
+            t0 = now_ns();
+            for (k = 0; k < iters; k++)
+                bench_call(i);
+            if (now_ns() - t0 >= BENCH_MIN_NS)
+                break;
+        }
 
-            /* We are only interested in memory access instructions */
-            if (buf[0] == ' ' && buf[2] == ' ' &&
-                (buf[1] == 'S' || buf[1] == 'M' || buf[1] == 'L'))
+        best = 1e30;
+        for (r = 0; r < runs; r++)
+        {
+            t0 = now_ns();
+            c0 = __rdtsc();
+            for (k = 0; k < iters; k++)
+                bench_call(i);
+            cycles = __rdtsc() - c0;
+            ns = now_ns() - t0;
+            if (ns < best)
             {
-                sscanf(buf + 3, "%llx,%u", &addr, &len);
-
-                /* If start marker found, set flag */
-                if (addr == marker_start)
-                    flag = 1;
-
-                /* Valgrind creates many spurious accesses to the
-                   stack that have nothing to do with the students
-                   code. At the moment, we are ignoring all stack
-                   accesses by using the simple filter of recording
-                   accesses to only the low 32-bit portion of the
-                   address space. At some point it would be nice to
-                   try to do more informed filtering so that would
-                   eliminate the valgrind stack references while
-                   include the student stack references. */
-                if (flag && addr < 0xffffffff)
-                {
-                    fputs(buf, part_trace_fp);
-                }
-
-                /* if end marker found, close trace file */
-                if (addr == marker_end)
-                {
-                    flag = 0;
-                    fclose(part_trace_fp);
-                    break;
-                }
+                best = ns;
+                best_cycles = cycles;
             }
         }
-        fclose(full_trace_fp);
+        best /= iters;
+        bytes = func_list[i].op ? func_list[i].op->bytes(M, N) : 2L * M * N * sizeof(int);
+        /* elements read and written once, so a batch counts all its matrices */
+        elem_size = func_list[i].op ? func_list[i].op->elem_size : sizeof(int);
+        printf("bench %d (%s): %.3f us, %.2f GB/s, %.2f cycles/element, simulated misses:%u%s\n",
+               i, func_list[i].description, best / 1000,
+               bytes / best,
+               (double)best_cycles / iters / (bytes / 2.0 / elem_size),
+               func_list[i].num_misses,
+               bench_correct(i) ? "" : " (incorrect)");
+    }
+}
 
-        /* Run the reference simulator */
-        printf("Step 2: Evaluating performance (s=%d, E=%d, b=%d)\n", s, E, b);
-        char cmd[255];
-        sprintf(cmd, "./csim-ref -s %u -E %u -b %u -t trace.f%d > /dev/null",
-                s, E, b, i);
-        system(cmd);
-
-        /* Collect results from the reference simulator */
-        FILE *in_fp = fopen(".csim_results", "r");
-        assert(in_fp);
-        fscanf(in_fp, "%u %u %u", &hits, &misses, &evictions);
-        fclose(in_fp);
-        func_list[i].num_hits = hits;
-        func_list[i].num_misses = misses;
-        func_list[i].num_evictions = evictions;
-        printf("func %u (%s): hits:%u, misses:%u, evictions:%u\n",
-               i, func_list[i].description, hits, misses, evictions);
-
-        /* If it is transpose_submit(), record number of misses */
-        if (results.funcid == i)
+/* Hardware counters read by -P */
+#define NUM_COUNTERS 5
+#define PERF_CALLS 16 /* calls per measurement, counts are reported per call */
+
+static const char *counter_names[NUM_COUNTERS] = {
+    "L1D misses", "LLC misses", "dTLB misses", "cycles", "instructions"};
+
+/*
+ * open_counter - Open counter k for this process (user space only),
+ *     or return -1 if this machine or kernel does not provide it
+ */
+static int open_counter(int k)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    attr.type = PERF_TYPE_HW_CACHE;
+    switch (k)
+    {
+    case 0:
+        attr.config = PERF_COUNT_HW_CACHE_L1D;
+        break;
+    case 1:
+        attr.config = PERF_COUNT_HW_CACHE_LL;
+        break;
+    case 2:
+        attr.config = PERF_COUNT_HW_CACHE_DTLB;
+        break;
+    case 3:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_CPU_CYCLES;
+        break;
+    default:
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+        break;
+    }
+    if (attr.type == PERF_TYPE_HW_CACHE)
+        attr.config |= (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                       (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/*
+ * counter_perf - Run every registered function natively under the
+ *     hardware counters and print them next to the simulated misses.
+ *     Counters the machine lacks print as n/a; if none can be opened
+ *     (no PMU in a VM, perf_event_paranoid too high) the mode is skipped.
+ */
+static void counter_perf(void)
+{
+    int fd[NUM_COUNTERS];
+    double value[NUM_COUNTERS];
+    unsigned long long data[3]; /* value, time enabled, time running */
+    int i, k, opened = 0, err = 0;
+
+    for (k = 0; k < NUM_COUNTERS; k++)
+    {
+        if ((fd[k] = open_counter(k)) >= 0)
+            opened++;
+        else
+            err = errno;
+    }
+    if (opened == 0)
+    {
+        printf("\nHardware counters unavailable (perf_event_open: %s), skipping -P\n",
+               strerror(err));
+        return;
+    }
+
+    printf("\nHardware counters %dx%d, seed %llu (per call, average of %d calls)\n", M, N, seed, PERF_CALLS);
+    for (i = 0; i < func_counter; i++)
+    {
+        /* Warm up so that page faults and cold code do not count */
+        bench_setup(i);
+        bench_call(i);
+        for (k = 0; k < NUM_COUNTERS; k++)
+            if (fd[k] >= 0)
+            {
+                ioctl(fd[k], PERF_EVENT_IOC_RESET, 0);
+                ioctl(fd[k], PERF_EVENT_IOC_ENABLE, 0);
+            }
+        for (k = 0; k < PERF_CALLS; k++)
+            bench_call(i);
+        for (k = 0; k < NUM_COUNTERS; k++)
+        {
+            value[k] = -1;
+            if (fd[k] < 0)
+                continue;
+            ioctl(fd[k], PERF_EVENT_IOC_DISABLE, 0);
+            /* Scale up if the kernel had to multiplex the counters */
+            if (read(fd[k], data, sizeof(data)) == sizeof(data) && data[2] > 0)
+                value[k] = (double)data[0] * data[1] / data[2] / PERF_CALLS;
+        }
+
+        printf("perf %d (%s):", i, func_list[i].description);
+        for (k = 0; k < NUM_COUNTERS; k++)
         {
-            results.misses = misses;
+            if (value[k] < 0)
+                printf(" %s:n/a", counter_names[k]);
+            else
+                printf(" %s:%.0f", counter_names[k], value[k]);
         }
+        if (value[3] > 0 && value[4] >= 0)
+            printf(" IPC:%.2f", value[4] / value[3]);
+        printf(", simulated misses:%u\n", func_list[i].num_misses);
     }
+    for (k = 0; k < NUM_COUNTERS; k++)
+        if (fd[k] >= 0)
+            close(fd[k]);
 }
 
 /*
@@ -170,11 +699,21 @@ void eval_perf(unsigned int s, unsigned int E, unsigned int b)
  */
 void usage(char *argv[])
 {
-    printf("Usage: %s [-h] -M <rows> -N <cols>\n", argv[0]);
+    printf("Usage: %s [-hLVPKR] [-g <s:E:b,...>] [-H <file>] [-j <jobs>] [-B <runs>] [-S <seed>] -M <rows> -N <cols>\n", argv[0]);
     printf("Options:\n");
     printf("  -h          Print this help message.\n");
     printf("  -M <rows>   Number of matrix rows (max %d)\n", MAXN);
     printf("  -N <cols>   Number of  matrix columns (max %d)\n", MAXN);
+    printf("  -L          Trace with valgrind (lackey) instead of tracegen-instr\n");
+    printf("  -V          Check the tracegen-instr counts against valgrind\n");
+    printf("  -j <jobs>   Evaluate up to <jobs> functions at once (0: one per core)\n");
+    printf("  -B <runs>   Also time every function natively, best of <runs> runs\n");
+    printf("  -P          Also read hardware counters (perf_event_open) per function\n");
+    printf("  -R          Also report each function's miss ratio on several caches\n");
+    printf("  -g <list>   Caches for -R as s:E:b[,s:E:b...] (implies -R)\n");
+    printf("  -H <file>   Write a per-tile conflict heatmap of every function to <file>\n");
+    printf("  -K          Also evaluate the matmul/stencil/matvec kernels in kernels.c\n");
+    printf("  -S <seed>   Seed of the generated inputs (default %d)\n", DEFAULT_SEED);
     printf("Example: %s -M 8 -N 8\n", argv[0]);
 }
 
@@ -207,7 +746,7 @@ int main(int argc, char *argv[])
 {
     char c;
 
-    while ((c = getopt(argc, argv, "M:N:h")) != -1)
+    while ((c = getopt(argc, argv, "M:N:hLVPKRg:H:j:B:S:")) != -1)
     {
         switch (c)
         {
@@ -217,6 +756,45 @@ int main(int argc, char *argv[])
         case 'N':
             N = atoi(optarg);
             break;
+        case 'L':
+            use_lackey = 1;
+            break;
+        case 'V':
+            check_lackey = 1;
+            break;
+        case 'j':
+            jobs = atoi(optarg);
+            if (jobs <= 0)
+                jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+            break;
+        case 'B':
+            bench_runs = atoi(optarg);
+            break;
+        case 'P':
+            perf_counters = 1;
+            break;
+        case 'K':
+            kernels = 1;
+            break;
+        case 'R':
+            robust = 1;
+            break;
+        case 'H':
+            heatmap = optarg;
+            break;
+        case 'S':
+            seed = strtoull(optarg, NULL, 10);
+            setSeed(seed);
+            break;
+        case 'g':
+            robust = 1;
+            if (!parse_geometries(optarg))
+            {
+                printf("Error: bad cache list \"%s\"\n", optarg);
+                usage(argv);
+                exit(1);
+            }
+            break;
         case 'h':
             usage(argv);
             exit(0);
@@ -253,11 +831,37 @@ int main(int argc, char *argv[])
         exit(1);
     }
 
+    /* tracegen-instr appends one function at a time: start empty, and
+       evaluate serially so that the functions stay in order in the file */
+    if (heatmap != NULL)
+    {
+        FILE *heat_fp = fopen(heatmap, "w");
+        if (heat_fp == NULL)
+        {
+            printf("Error: cannot create %s\n", heatmap);
+            exit(1);
+        }
+        fclose(heat_fp);
+        if (use_lackey)
+            printf("Note: -H needs tracegen-instr, no heatmap is written with -L\n");
+        jobs = 1;
+    }
+
     /* Time out and give up after a while */
     alarm(120);
 
     /* Check the performance of the student's transpose function */
-    eval_perf(5, 1, 5);
+    eval_perf(5, 1, 5, jobs);
+
+    /* Check that the functions hold up on other caches too */
+    if (robust)
+        eval_robust();
+
+    /* Measure the real speed of each function */
+    if (bench_runs > 0)
+        bench_perf(bench_runs);
+    if (perf_counters)
+        counter_perf();
 
     /* Emit the results for this particular test */
     if (results.funcid == -1)
@@ -269,8 +873,8 @@ int main(int argc, char *argv[])
     }
     else
     {
-        printf("\nSummary for official submission (func %d): correctness=%d misses=%d\n",
-               results.funcid, results.correct, results.misses);
+        printf("\nSummary for official submission (func %d): correctness=%d misses=%d seed=%llu\n",
+               results.funcid, results.correct, results.misses, seed);
         printf("\nTEST_TRANS_RESULTS=%d:%d\n", results.correct, results.misses);
     }
     return 0;
@@ -4,7 +4,28 @@
  * 
  * The beginning and end of each registered transpose function's trace
  * is indicated by reading from "marker" addresses. These two marker
- * addresses are recorded in file for later use.
+ * addresses are recorded in file for later use, and printed on a
+ * "MARKERS" line ahead of the functions' accesses.
+ *
+ * Built with -DTRACE_INSTRUMENT (as tracegen-instr), it instead runs
+ * trans.c compiled with call-based address-sanitizer instrumentation:
+ * every load and store calls one of the __asan_* hooks below, which
+ * feed the address straight into the simulator from csim.c. This
+ * gives the same hit/miss/eviction counts as the valgrind path in
+ * milliseconds, without writing a trace.
+ *
+ * With -H <file> tracegen-instr also appends a conflict heatmap for
+ * each function to file: misses per 8x8 tile of A and of B, how many
+ * of them re-fetch a block that an earlier access evicted, and which
+ * tiles those evicting accesses fell in.
+ *
+ * With -K the kernels in kernels.c are registered after the transpose
+ * functions; each runs on its own A, X and Y buffers (wide enough for
+ * 8-byte elements) and is validated with its own operation's reference.
+ *
+ * Every input comes from the seeded generator in cachelab.c; -S <seed>
+ * picks the seed (default DEFAULT_SEED), so a run, its trace and any
+ * validation failure can be repeated exactly.
  */
 
 #include <stdlib.h>
@@ -19,21 +40,335 @@
 extern trans_func_t func_list[MAX_TRANS_FUNCS];
 extern int func_counter;
 
-/* External function from trans.c */
+/* External functions from trans.c and kernels.c */
 extern void registerFunctions();
+extern void registerKernels();
 
 /* Markers used to bound trace regions of interest */
 volatile char MARKER_START, MARKER_END;
 
 static int A[256][256];
 static int B[256][256];
+/* Kernel operands, sized for 256 x 256 elements of up to 8 bytes */
+static long long kernel_A[256 * 256];
+static long long kernel_X[256 * 256];
+static long long kernel_Y[256 * 256];
+static long long expect[256 * 256];
 static int M;
 static int N;
 
+#ifdef TRACE_INSTRUMENT
+/* Embedded simulator from csim.c (compiled with -DCSIM_LIBRARY) */
+extern void csimInit(int s, int E, int b);
+extern void csimAccess(unsigned long long address, int store);
+extern int csimAccessVictim(unsigned long long address, int store,
+                            unsigned long long *victim);
+extern void csimResults(long *hits, long *misses, long *evictions);
+
+static int s = 5, E = 1, b = 5;
+static int recording = 0;
+static char *stack_lo, *stack_hi;
+
+/* -H: conflict heatmap */
+#define HEAT_TILE 8   /* tile edge in elements, as in the 8x8 blocking */
+#define HEAT_TILES 32 /* tiles per matrix edge for M, N <= 256 */
+#define HEAT_PAIRS 40 /* victim/evictor tile pairs printed per function */
+#define MATRIX_BYTES (256 * 256 * sizeof(int))
+static FILE *heat_fp;
+static unsigned long long *evictor[2]; /* per block of A, B: address that evicted it, 0 if none */
+static char *touched[2];               /* per block of A, B: fetched before */
+static unsigned int tile_misses[2][HEAT_TILES * HEAT_TILES];
+static unsigned int tile_conflicts[2][HEAT_TILES * HEAT_TILES];
+static unsigned long other_misses;
+static long *pairs; /* victim tile key << 16 | evictor tile key, one per conflict miss */
+static long num_pairs, max_pairs;
+
+/*
+ * locate - Which of A (0) and B (1) addr falls in, as the function sees
+ *     them (A[N][M], B[M][N]), with its tile and block; -1 otherwise
+ */
+static int locate(unsigned long long addr, int *tile, long *block)
+{
+    unsigned long long base[2] = {(unsigned long long)A, (unsigned long long)B};
+    int rows[2] = {N, M}, cols[2] = {M, N};
+    long elem;
+    int m;
+
+    for (m = 0; m < 2; m++)
+    {
+        if (addr < base[m] || addr >= base[m] + (unsigned long long)rows[m] * cols[m] * sizeof(int))
+            continue;
+        elem = (addr - base[m]) / sizeof(int);
+        *tile = (elem / cols[m] / HEAT_TILE) * HEAT_TILES + elem % cols[m] / HEAT_TILE;
+        *block = (addr - base[m]) >> b;
+        return m;
+    }
+    return -1;
+}
+
+/*
+ * heatAccess - Simulate one access and attribute a miss to its matrix
+ *     and tile. A miss on a block that was fetched before is a conflict
+ *     (or capacity) miss; the access that evicted the block is paired
+ *     with it. Every eviction of a block of A or B remembers its evictor.
+ */
+static void heatAccess(unsigned long long addr, int store)
+{
+    unsigned long long victim;
+    int res, m, vm, tile, vtile = 0, etile = 0;
+    long block, vblock;
+
+    res = csimAccessVictim(addr, store, &victim);
+    if (res == 0)
+        return;
+    if ((m = locate(addr, &tile, &block)) < 0)
+        other_misses++;
+    else
+    {
+        tile_misses[m][tile]++;
+        if (touched[m][block] && evictor[m][block] != 0)
+        {
+            tile_conflicts[m][tile]++;
+            vm = locate(evictor[m][block], &vtile, &vblock);
+            etile = vm < 0 ? 2 << 10 : vm << 10 | vtile;
+            if (num_pairs == max_pairs)
+            {
+                max_pairs = max_pairs ? 2 * max_pairs : 4096;
+                pairs = realloc(pairs, max_pairs * sizeof(long));
+                assert(pairs);
+            }
+            pairs[num_pairs++] = (long)(m << 10 | tile) << 16 | etile;
+        }
+        touched[m][block] = 1;
+        evictor[m][block] = 0;
+    }
+    if (res == 2 && (vm = locate(victim, &vtile, &vblock)) >= 0)
+        evictor[vm][vblock] = addr;
+}
+
+/*
+ * simulate - Pass one access to the simulator, through the heatmap
+ *     bookkeeping when -H is on
+ */
+static void simulate(unsigned long long addr, int store)
+{
+    if (heat_fp)
+        heatAccess(addr, store);
+    else
+        csimAccess(addr, store);
+}
+
+/*
+ * heatReset - Forget the previous function's heatmap
+ */
+static void heatReset(void)
+{
+    int m;
+
+    for (m = 0; m < 2; m++)
+    {
+        free(evictor[m]);
+        free(touched[m]);
+        evictor[m] = calloc((MATRIX_BYTES >> b) + 1, sizeof(unsigned long long));
+        touched[m] = calloc((MATRIX_BYTES >> b) + 1, 1);
+        assert(evictor[m] && touched[m]);
+    }
+    memset(tile_misses, 0, sizeof(tile_misses));
+    memset(tile_conflicts, 0, sizeof(tile_conflicts));
+    other_misses = 0;
+    num_pairs = 0;
+}
+
+/* Name of a tile key: matrix 0, 1 or 2 (other) in bit 11 up, tile below */
+static void tileName(long key, char *buf)
+{
+    static const char *names[] = {"A", "B"};
+
+    if ((key >> 10) >= 2)
+        sprintf(buf, "other");
+    else
+        sprintf(buf, "%s(%ld,%ld)", names[key >> 10], (key & 1023) / HEAT_TILES,
+                (key & 1023) % HEAT_TILES);
+}
+
+static int comparePairs(const void *x, const void *y)
+{
+    long a = *(const long *)x, c = *(const long *)y;
+    return a < c ? -1 : a > c;
+}
+
+/*
+ * heatPrint - Append function fn's heatmap to the -H file: per tile,
+ *     misses and, in parentheses, the conflict misses among them, then
+ *     the victim <- evictor tile pairs that caused the most conflicts
+ */
+static void heatPrint(int fn)
+{
+    static const char *names[] = {"A", "B"};
+    int rows[2] = {N, M}, cols[2] = {M, N};
+    int m, tr, tc, p, k, top[HEAT_PAIRS], count[HEAT_PAIRS], n, shown = 0;
+    unsigned long total[2] = {0, 0}, conflicts[2] = {0, 0};
+    char victim[32], by[32];
+    long i, j;
+
+    for (m = 0; m < 2; m++)
+        for (k = 0; k < HEAT_TILES * HEAT_TILES; k++)
+        {
+            total[m] += tile_misses[m][k];
+            conflicts[m] += tile_conflicts[m][k];
+        }
+    fprintf(heat_fp, "func %d (%s) M=%d N=%d s=%d E=%d b=%d: A misses:%lu (conflict %lu), B misses:%lu (conflict %lu), other misses:%lu\n",
+            fn, func_list[fn].description, M, N, s, E, b, total[0], conflicts[0],
+            total[1], conflicts[1], other_misses);
+    if (func_list[fn].op)
+    {
+        fprintf(heat_fp, "  (kernels do not use A and B; only transposes are mapped)\n\n");
+        return;
+    }
+
+    for (m = 0; m < 2; m++)
+    {
+        fprintf(heat_fp, "%s misses (conflict misses) per %dx%d tile, %d x %d tiles\n",
+                names[m], HEAT_TILE, HEAT_TILE, (rows[m] + HEAT_TILE - 1) / HEAT_TILE,
+                (cols[m] + HEAT_TILE - 1) / HEAT_TILE);
+        for (tr = 0; tr * HEAT_TILE < rows[m]; tr++)
+        {
+            for (tc = 0; tc * HEAT_TILE < cols[m]; tc++)
+                fprintf(heat_fp, " %4u(%3u)", tile_misses[m][tr * HEAT_TILES + tc],
+                        tile_conflicts[m][tr * HEAT_TILES + tc]);
+            fprintf(heat_fp, "\n");
+        }
+    }
+
+    /* Count equal pairs after sorting, keep the HEAT_PAIRS largest */
+    qsort(pairs, num_pairs, sizeof(long), comparePairs);
+    for (i = 0; i < num_pairs; i = j)
+    {
+        for (j = i; j < num_pairs && pairs[j] == pairs[i]; j++)
+            ;
+        n = (int)(j - i);
+        for (p = shown; p > 0 && count[p - 1] < n; p--)
+            if (p < HEAT_PAIRS)
+            {
+                top[p] = top[p - 1];
+                count[p] = count[p - 1];
+            }
+        if (p < HEAT_PAIRS)
+        {
+            top[p] = (int)i;
+            count[p] = n;
+            if (shown < HEAT_PAIRS)
+                shown++;
+        }
+    }
+    fprintf(heat_fp, "conflict misses by victim tile <- evicting tile (top %d)\n", shown);
+    for (p = 0; p < shown; p++)
+    {
+        tileName(pairs[top[p]] >> 16, victim);
+        tileName(pairs[top[p]] & 0xffff, by);
+        fprintf(heat_fp, "  %s <- %s: %d\n", victim, by, count[p]);
+    }
+    fprintf(heat_fp, "\n");
+}
+
+/*
+ * record - Pass one access made by a transpose function to the
+ *     simulator. Like the 0xffffffff filter in test-trans, stack
+ *     accesses (locals, spilled arguments) are dropped. Addresses are
+ *     the native ones, so they differ from valgrind's only above the
+ *     page offset, which does not change any set index for s+b <= 12.
+ */
+static void record(void *addr, int store)
+{
+    if (!recording)
+        return;
+    if ((char *)addr >= stack_lo && (char *)addr < stack_hi)
+        return;
+    simulate((unsigned long long)addr, store);
+}
+
+/* Hooks called by -fsanitize=kernel-address code in trans-instr.o */
+#define ACCESS_HOOKS(size)                                      \
+    void __asan_load##size##_noabort(void *addr) { record(addr, 0); } \
+    void __asan_store##size##_noabort(void *addr) { record(addr, 1); }
+ACCESS_HOOKS(1)
+ACCESS_HOOKS(2)
+ACCESS_HOOKS(4)
+ACCESS_HOOKS(8)
+ACCESS_HOOKS(16)
+void __asan_loadN_noabort(void *addr, long size) { record(addr, 0); }
+void __asan_storeN_noabort(void *addr, long size) { record(addr, 1); }
+#endif
+
+/*
+ * runFunc - Run one registered function between the two markers
+ */
+static void runFunc(int fn)
+{
+#ifdef TRACE_INSTRUMENT
+    long hits, misses, evictions;
+
+    /* Start each function on a cold cache. Between the markers lackey
+       also sees the marker stores and the call loading func_ptr, N, M */
+    csimInit(s, E, b);
+    if (heat_fp)
+        heatReset();
+    simulate((unsigned long long)&MARKER_START, 1);
+    if (func_list[fn].op)
+        simulate((unsigned long long)&func_list[fn].kernel_ptr, 0);
+    else
+        simulate((unsigned long long)&func_list[fn].func_ptr, 0);
+    simulate((unsigned long long)&N, 0);
+    simulate((unsigned long long)&M, 0);
+    recording = 1;
+#endif
+    /* An in-place kernel starts from a copy of its input, made before
+       the marker so that it is not part of the trace */
+    if (func_list[fn].op && func_list[fn].op->in_place)
+        memcpy(kernel_Y, kernel_A, (size_t)M * N * func_list[fn].op->elem_size);
+    MARKER_START = 33;
+    if (func_list[fn].op)
+        (*func_list[fn].kernel_ptr)(M, N, kernel_A, kernel_X, kernel_Y);
+    else
+        (*func_list[fn].func_ptr)(M, N, A, B);
+    MARKER_END = 34;
+#ifdef TRACE_INSTRUMENT
+    recording = 0;
+    simulate((unsigned long long)&MARKER_END, 1);
+    if (heat_fp)
+        heatPrint(fn);
+    csimResults(&hits, &misses, &evictions);
+    printf("func %d ", fn);
+    printSummary(hits, misses, evictions);
+#endif
+}
+
+/*
+ * validateKernel - Check the output of kernel fn against the reference
+ *     for its operation
+ */
+static int validateKernel(int fn)
+{
+    const kernel_op_t *op = func_list[fn].op;
+    long k;
+
+    op->reference(M, N, kernel_A, kernel_X, expect);
+    k = op->validate(M, N, kernel_Y, expect);
+    if (k >= 0)
+    {
+        printf("Validation failed on function %d (%s)! Expected %g but got %g at element %ld (seed %llu)\n",
+               fn, op->name, op->value(expect, k), op->value(kernel_Y, k), k, getSeed());
+        return 0;
+    }
+    return 1;
+}
+
 int validate(int fn, int M, int N, int A[N][M], int B[M][N])
 {
     int C[M][N];
     int i, j;
+    if (func_list[fn].op)
+        return validateKernel(fn);
     memset(C, 0, sizeof(C));
     correctTrans(M, N, A, C);
     for (i = 0; i < M; i++)
@@ -42,7 +377,7 @@ int validate(int fn, int M, int N, int A[N][M], int B[M][N])
         {
             if (B[i][j] != C[i][j])
             {
-                printf("Validation failed on function %d! Expected %d but got %d at B[%d][%d]\n", fn, C[i][j], B[i][j], i, j);
+                printf("Validation failed on function %d! Expected %d but got %d at B[%d][%d] (seed %llu)\n", fn, C[i][j], B[i][j], i, j, getSeed());
                 return 0;
             }
         }
@@ -56,7 +391,17 @@ int main(int argc, char *argv[])
 
     char c;
     int selectedFunc = -1;
-    while ((c = getopt(argc, argv, "M:N:F:")) != -1)
+    int kernels = 0;
+#ifdef TRACE_INSTRUMENT
+    char top;
+
+    /* Everything the transpose functions put on the stack is below main's frame */
+    stack_hi = &top + 4096;
+    stack_lo = &top - (256 << 20);
+    while ((c = getopt(argc, argv, "M:N:F:KS:s:E:b:H:")) != -1)
+#else
+    while ((c = getopt(argc, argv, "M:N:F:KS:")) != -1)
+#endif
     {
         switch (c)
         {
@@ -69,6 +414,27 @@ int main(int argc, char *argv[])
         case 'F':
             selectedFunc = atoi(optarg);
             break;
+        case 'K':
+            kernels = 1;
+            break;
+        case 'S':
+            setSeed(strtoull(optarg, NULL, 10));
+            break;
+#ifdef TRACE_INSTRUMENT
+        case 's':
+            s = atoi(optarg);
+            break;
+        case 'E':
+            E = atoi(optarg);
+            break;
+        case 'b':
+            b = atoi(optarg);
+            break;
+        case 'H':
+            heat_fp = fopen(optarg, "a");
+            assert(heat_fp);
+            break;
+#endif
         case '?':
         default:
             printf("./tracegen failed to parse its options.\n");
@@ -78,6 +444,8 @@ int main(int argc, char *argv[])
 
     /*  Register transpose functions */
     registerFunctions();
+    if (kernels)
+        registerKernels();
 
     /* Fill A with data */
     initMatrix(M, N, A, B);
@@ -89,24 +457,33 @@ int main(int argc, char *argv[])
             (unsigned long long int)&MARKER_START,
             (unsigned long long int)&MARKER_END);
     fclose(marker_fp);
+#ifndef TRACE_INSTRUMENT
+    /* Also announce them in our output, which under valgrind --log-fd=1
+       is the trace stream itself: test-trans filters that stream as it
+       arrives, before it could safely read .marker */
+    printf("MARKERS %llx %llx\n",
+           (unsigned long long int)&MARKER_START,
+           (unsigned long long int)&MARKER_END);
+    fflush(stdout);
+#endif
 
     if (-1 == selectedFunc)
     {
         /* Invoke registered transpose functions */
         for (i = 0; i < func_counter; i++)
         {
-            MARKER_START = 33;
-            (*func_list[i].func_ptr)(M, N, A, B);
-            MARKER_END = 34;
+            if (func_list[i].op)
+                func_list[i].op->init(M, N, kernel_A, kernel_X);
+            runFunc(i);
             if (!validate(i, M, N, A, B))
                 return i + 1;
         }
     }
     else
     {
-        MARKER_START = 33;
-        (*func_list[selectedFunc].func_ptr)(M, N, A, B);
-        MARKER_END = 34;
+        if (func_list[selectedFunc].op)
+            func_list[selectedFunc].op->init(M, N, kernel_A, kernel_X);
+        runFunc(selectedFunc);
         if (!validate(selectedFunc, M, N, A, B))
             return selectedFunc + 1;
     }
@@ -12,9 +12,14 @@
  * on a 1KB direct mapped cache with a block size of 32 bytes.
  */
 #include <stdio.h>
+#include <immintrin.h>
 #include "cachelab.h"
 
 int is_transpose(int M, int N, int A[N][M], int B[M][N]);
+void transRecursive(int M, int N, int A[N][M], int B[M][N], int r0, int r1, int c0, int c1);
+#ifdef TRANS_TUNED
+void registerTunedFunctions(); //./autotune가 만든 trans-tuned.c
+#endif
 
 /* 
  * transpose_submit - This is the solution transpose function that you
@@ -130,6 +135,154 @@ void transpose_submit(int M, int N, int A[N][M], int B[M][N])
             }
         }
     }
+    else
+    {
+        //그 외 크기는 cache-oblivious 재귀 transpose로 처리
+        transRecursive(M, N, A, B, 0, N, 0, M);
+    }
+}
+
+//재귀를 멈추는 tile 크기, 32byte block 하나에 int 8개
+#define TILE 8
+
+/*
+ * transTileStaged - 64x64에서 쓴 방법을 8x8 tile 하나에 적용.
+ *     B의 2~4줄마다 같은 set을 쓰면(N이 64의 배수) B의 4x8 구역에 임시로
+ *     저장했다가 원위치로 옮긴다.
+ */
+static void transTileStaged(int M, int N, int A[N][M], int B[M][N], int r0, int c0)
+{
+    int val1, val2, val3, val4, val5, val6, val7, val8;
+    int i0;
+
+    for (i0 = 0; i0 < 4; i0++)
+    {
+        val1 = A[r0 + i0][c0];
+        val2 = A[r0 + i0][c0 + 1];
+        val3 = A[r0 + i0][c0 + 2];
+        val4 = A[r0 + i0][c0 + 3];
+        val5 = A[r0 + i0][c0 + 4];
+        val6 = A[r0 + i0][c0 + 5];
+        val7 = A[r0 + i0][c0 + 6];
+        val8 = A[r0 + i0][c0 + 7];
+        B[c0][r0 + i0] = val1;
+        B[c0 + 1][r0 + i0] = val2;
+        B[c0 + 2][r0 + i0] = val3;
+        B[c0 + 3][r0 + i0] = val4;
+        B[c0][r0 + i0 + 4] = val5;
+        B[c0 + 1][r0 + i0 + 4] = val6;
+        B[c0 + 2][r0 + i0 + 4] = val7;
+        B[c0 + 3][r0 + i0 + 4] = val8;
+    }
+    for (i0 = 4; i0 < 8; i0++)
+    {
+        val1 = B[c0 + i0 - 4][r0 + 4];
+        val2 = B[c0 + i0 - 4][r0 + 5];
+        val3 = B[c0 + i0 - 4][r0 + 6];
+        val4 = B[c0 + i0 - 4][r0 + 7];
+
+        B[c0 + i0 - 4][r0 + 4] = A[r0 + 4][c0 + i0 - 4];
+        B[c0 + i0 - 4][r0 + 5] = A[r0 + 5][c0 + i0 - 4];
+        B[c0 + i0 - 4][r0 + 6] = A[r0 + 6][c0 + i0 - 4];
+        B[c0 + i0 - 4][r0 + 7] = A[r0 + 7][c0 + i0 - 4];
+
+        B[c0 + i0][r0] = val1;
+        B[c0 + i0][r0 + 1] = val2;
+        B[c0 + i0][r0 + 2] = val3;
+        B[c0 + i0][r0 + 3] = val4;
+    }
+    for (i0 = 0; i0 < 4; i0++)
+    {
+        B[c0 + 4 + i0][r0 + 4] = A[r0 + 4][c0 + 4 + i0];
+        B[c0 + 4 + i0][r0 + 5] = A[r0 + 5][c0 + 4 + i0];
+        B[c0 + 4 + i0][r0 + 6] = A[r0 + 6][c0 + 4 + i0];
+        B[c0 + 4 + i0][r0 + 7] = A[r0 + 7][c0 + 4 + i0];
+    }
+}
+
+/*
+ * transTile - A[r0..r1)[c0..c1) 부분을 B로 옮기는 재귀의 base case.
+ *     폭이 8인 tile은 transpose_submit처럼 A의 한 줄을 register에
+ *     전부 읽은 뒤 B에 써서, 대각선 tile에서 A와 B가 같은 set을
+ *     번갈아 쫓아내는 것을 막는다.
+ */
+static void transTile(int M, int N, int A[N][M], int B[M][N], int r0, int r1, int c0, int c1)
+{
+    int val1, val2, val3, val4, val5, val6, val7, val8;
+    int i, j;
+
+    if (c1 - c0 == TILE && r1 - r0 == TILE && N % 64 == 0 && N % 256 != 0)
+    {
+        transTileStaged(M, N, A, B, r0, c0);
+    }
+    else if (c1 - c0 == TILE)
+    {
+        for (i = r0; i < r1; i++)
+        {
+            val1 = A[i][c0];
+            val2 = A[i][c0 + 1];
+            val3 = A[i][c0 + 2];
+            val4 = A[i][c0 + 3];
+            val5 = A[i][c0 + 4];
+            val6 = A[i][c0 + 5];
+            val7 = A[i][c0 + 6];
+            val8 = A[i][c0 + 7];
+            B[c0][i] = val1;
+            B[c0 + 1][i] = val2;
+            B[c0 + 2][i] = val3;
+            B[c0 + 3][i] = val4;
+            B[c0 + 4][i] = val5;
+            B[c0 + 5][i] = val6;
+            B[c0 + 6][i] = val7;
+            B[c0 + 7][i] = val8;
+        }
+    }
+    else
+    {
+        for (i = r0; i < r1; i++)
+        {
+            for (j = c0; j < c1; j++)
+            {
+                B[j][i] = A[i][j];
+            }
+        }
+    }
+}
+
+/*
+ * transRecursive - A[r0..r1)[c0..c1)의 transpose를 B에 저장.
+ *     긴 쪽을 TILE 배수 위치에서 반으로 나누는 것을 반복해서 cache 크기를
+ *     몰라도 어느 단계에선가 부분 matrix가 cache에 들어가게 한다.
+ */
+void transRecursive(int M, int N, int A[N][M], int B[M][N], int r0, int r1, int c0, int c1)
+{
+    int half;
+
+    if (r1 - r0 <= TILE && c1 - c0 <= TILE)
+    {
+        transTile(M, N, A, B, r0, r1, c0, c1);
+    }
+    else if (r1 - r0 >= c1 - c0)
+    {
+        half = ((r1 - r0) / 2 + TILE - 1) / TILE * TILE;
+        transRecursive(M, N, A, B, r0, r0 + half, c0, c1);
+        transRecursive(M, N, A, B, r0 + half, r1, c0, c1);
+    }
+    else
+    {
+        half = ((c1 - c0) / 2 + TILE - 1) / TILE * TILE;
+        transRecursive(M, N, A, B, r0, r1, c0, c0 + half);
+        transRecursive(M, N, A, B, r0, r1, c0 + half, c1);
+    }
+}
+
+/*
+ * trans_recursive - 모든 M, N에서 재귀 transpose만 사용 (비교용)
+ */
+char trans_recursive_desc[] = "Cache-oblivious recursive transpose";
+void trans_recursive(int M, int N, int A[N][M], int B[M][N])
+{
+    transRecursive(M, N, A, B, 0, N, 0, M);
 }
 
 /* 
@@ -155,6 +308,126 @@ void trans(int M, int N, int A[N][M], int B[M][N])
     }
 }
 
+/*
+ * transBlockAVX2 - A[i..i+8)[j..j+8) 8x8 block을 AVX2로 transpose.
+ *     한 줄씩 8개를 읽고 32bit, 64bit unpack으로 128bit lane 안에서
+ *     4x4씩 뒤집은 다음 두 lane을 permute로 맞바꾼다.
+ */
+__attribute__((target("avx2"))) static void transBlockAVX2(int M, int N, int A[N][M], int B[M][N], int i, int j)
+{
+    __m256i r0, r1, r2, r3, r4, r5, r6, r7;
+    __m256i t0, t1, t2, t3, t4, t5, t6, t7;
+
+    r0 = _mm256_loadu_si256((const __m256i *)&A[i][j]);
+    r1 = _mm256_loadu_si256((const __m256i *)&A[i + 1][j]);
+    r2 = _mm256_loadu_si256((const __m256i *)&A[i + 2][j]);
+    r3 = _mm256_loadu_si256((const __m256i *)&A[i + 3][j]);
+    r4 = _mm256_loadu_si256((const __m256i *)&A[i + 4][j]);
+    r5 = _mm256_loadu_si256((const __m256i *)&A[i + 5][j]);
+    r6 = _mm256_loadu_si256((const __m256i *)&A[i + 6][j]);
+    r7 = _mm256_loadu_si256((const __m256i *)&A[i + 7][j]);
+
+    //[a0 b0 a1 b1 | a4 b4 a5 b5] 형태로 두 줄씩 섞기
+    t0 = _mm256_unpacklo_epi32(r0, r1);
+    t1 = _mm256_unpackhi_epi32(r0, r1);
+    t2 = _mm256_unpacklo_epi32(r2, r3);
+    t3 = _mm256_unpackhi_epi32(r2, r3);
+    t4 = _mm256_unpacklo_epi32(r4, r5);
+    t5 = _mm256_unpackhi_epi32(r4, r5);
+    t6 = _mm256_unpacklo_epi32(r6, r7);
+    t7 = _mm256_unpackhi_epi32(r6, r7);
+
+    //[a0 b0 c0 d0 | a4 b4 c4 d4] 형태, lane마다 4x4 transpose 완성
+    r0 = _mm256_unpacklo_epi64(t0, t2);
+    r1 = _mm256_unpackhi_epi64(t0, t2);
+    r2 = _mm256_unpacklo_epi64(t1, t3);
+    r3 = _mm256_unpackhi_epi64(t1, t3);
+    r4 = _mm256_unpacklo_epi64(t4, t6);
+    r5 = _mm256_unpackhi_epi64(t4, t6);
+    r6 = _mm256_unpacklo_epi64(t5, t7);
+    r7 = _mm256_unpackhi_epi64(t5, t7);
+
+    //아래 lane끼리 모으면 열 0~3, 위 lane끼리 모으면 열 4~7
+    _mm256_storeu_si256((__m256i *)&B[j][i], _mm256_permute2x128_si256(r0, r4, 0x20));
+    _mm256_storeu_si256((__m256i *)&B[j + 1][i], _mm256_permute2x128_si256(r1, r5, 0x20));
+    _mm256_storeu_si256((__m256i *)&B[j + 2][i], _mm256_permute2x128_si256(r2, r6, 0x20));
+    _mm256_storeu_si256((__m256i *)&B[j + 3][i], _mm256_permute2x128_si256(r3, r7, 0x20));
+    _mm256_storeu_si256((__m256i *)&B[j + 4][i], _mm256_permute2x128_si256(r0, r4, 0x31));
+    _mm256_storeu_si256((__m256i *)&B[j + 5][i], _mm256_permute2x128_si256(r1, r5, 0x31));
+    _mm256_storeu_si256((__m256i *)&B[j + 6][i], _mm256_permute2x128_si256(r2, r6, 0x31));
+    _mm256_storeu_si256((__m256i *)&B[j + 7][i], _mm256_permute2x128_si256(r3, r7, 0x31));
+}
+
+/*
+ * transBlockSSE - A[i..i+4)[j..j+4) 4x4 block을 SSE2로 transpose
+ */
+static void transBlockSSE(int M, int N, int A[N][M], int B[M][N], int i, int j)
+{
+    __m128i r0, r1, r2, r3, t0, t1, t2, t3;
+
+    r0 = _mm_loadu_si128((const __m128i *)&A[i][j]);
+    r1 = _mm_loadu_si128((const __m128i *)&A[i + 1][j]);
+    r2 = _mm_loadu_si128((const __m128i *)&A[i + 2][j]);
+    r3 = _mm_loadu_si128((const __m128i *)&A[i + 3][j]);
+
+    t0 = _mm_unpacklo_epi32(r0, r1); //a0 b0 a1 b1
+    t1 = _mm_unpacklo_epi32(r2, r3); //c0 d0 c1 d1
+    t2 = _mm_unpackhi_epi32(r0, r1); //a2 b2 a3 b3
+    t3 = _mm_unpackhi_epi32(r2, r3); //c2 d2 c3 d3
+
+    _mm_storeu_si128((__m128i *)&B[j][i], _mm_unpacklo_epi64(t0, t1));
+    _mm_storeu_si128((__m128i *)&B[j + 1][i], _mm_unpackhi_epi64(t0, t1));
+    _mm_storeu_si128((__m128i *)&B[j + 2][i], _mm_unpacklo_epi64(t2, t3));
+    _mm_storeu_si128((__m128i *)&B[j + 3][i], _mm_unpackhi_epi64(t2, t3));
+}
+
+/*
+ * trans_simd - 8x8 block 단위 SIMD transpose. AVX2가 있으면 AVX2 kernel,
+ *     없으면 SSE2 4x4 kernel 4개로 처리하고, 8로 나누어 떨어지지 않는
+ *     가장자리는 scalar로 옮긴다.
+ */
+char trans_simd_desc[] = "SIMD 8x8 block transpose (AVX2/SSE2)";
+void trans_simd(int M, int N, int A[N][M], int B[M][N])
+{
+    int i, j, i0;
+    int avx2 = __builtin_cpu_supports("avx2");
+    int N8 = N / 8 * 8, M8 = M / 8 * 8;
+
+    for (i = 0; i < N8; i += 8)
+    {
+        for (j = 0; j < M8; j += 8)
+        {
+            if (avx2)
+            {
+                transBlockAVX2(M, N, A, B, i, j);
+            }
+            else
+            {
+                transBlockSSE(M, N, A, B, i, j);
+                transBlockSSE(M, N, A, B, i, j + 4);
+                transBlockSSE(M, N, A, B, i + 4, j);
+                transBlockSSE(M, N, A, B, i + 4, j + 4);
+            }
+        }
+        //오른쪽 가장자리 열
+        for (i0 = i; i0 < i + 8; i0++)
+        {
+            for (j = M8; j < M; j++)
+            {
+                B[j][i0] = A[i0][j];
+            }
+        }
+    }
+    //아래쪽 가장자리 줄
+    for (i = N8; i < N; i++)
+    {
+        for (j = 0; j < M; j++)
+        {
+            B[j][i] = A[i][j];
+        }
+    }
+}
+
 /*
  * registerFunctions - This function registers your transpose
  *     functions with the driver.  At runtime, the driver will
@@ -169,6 +442,13 @@ void registerFunctions()
 
     /* Register any additional transpose functions */
     registerTransFunction(trans, trans_desc);
+    registerTransFunction(trans_recursive, trans_recursive_desc);
+    registerTransFunction(trans_simd, trans_simd_desc);
+
+#ifdef TRANS_TUNED
+    /* Register the kernel generated by ./autotune */
+    registerTunedFunctions();
+#endif
 }
 
 /* 